@@ -0,0 +1,265 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+// Benchmarks the generator itself: loading the unicode data, filtering the
+// general categories (filter_multiple_gc), building the match tree and
+// creating the predicate. The cases are every general category, every
+// pairwise union of general categories, and a few synthetic worst cases.
+// Every case is repeated, and the median, minimum and median absolute
+// deviation of its times are reported, so that two runs can be compared.
+//
+// It is built from all the generator sources except main.cpp:
+//
+//		g++ -O2 -o uniclasser_benchmark benchmark/benchmark.cpp $(ls *.cpp | grep -v '^main.cpp$')
+//
+// usage: uniclasser_benchmark [-v] [-n repetitions] [-u path]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <cstdlib>
+#include <cmath>
+#include "unistd.h"
+#include "../unicode_data.hpp"
+#include "../match_tree.hpp"
+#include "../predicate.hpp"
+#include "../stats.hpp"
+
+using namespace std;
+
+
+//----- Samples ---------------------------------------------------------------
+
+struct Samples
+{
+	void add(double t) { times.push_back(t); }
+
+	double median() const
+	{
+		vector<double> t(times);
+		sort(t.begin(), t.end());
+		size_t n = t.size();
+		return n == 0 ? 0 : n % 2 ? t[n/2] : (t[n/2-1] + t[n/2]) / 2;
+	}
+
+	double min() const { return times.empty() ? 0 : *min_element(times.begin(), times.end()); }
+
+	double mad() const	// median absolute deviation, which unlike the standard deviation ignores outliers
+	{
+		double m = median();
+		Samples d;
+		for (vector<double>::const_iterator i = times.begin(); i != times.end(); ++i) d.add(fabs(*i - m));
+		return d.median();
+	}
+
+	vector<double> times;	// microseconds
+};
+
+
+//----- Cases -----------------------------------------------------------------
+
+// A case is either a category spec for filter_multiple_gc(), or a synthetic
+// set of codevalues that skips the filter stage.
+struct Case
+{
+	Case(string group, string name) : group(group), name(name), synthetic(false) {}
+
+	string group, name;
+	bool synthetic;
+	range_list ranges;
+
+	enum { filter_stage, tree_stage, predicate_stage, stages };
+	Samples samples[stages];
+	unsigned compare_jumps;
+};
+
+static const char * const stage_names[Case::stages] = { "filter", "tree", "predicate" };
+
+Case synthetic_case(string name, codevalue_vector &codes)
+{
+	sort(codes.begin(), codes.end());
+	codes.erase(unique(codes.begin(), codes.end()), codes.end());
+	auto_ptr<range_list> ranges(to_ranges(codes));
+
+	Case c("synthetic", name);
+	c.synthetic = true;
+	c.ranges = *ranges;
+	return c;
+}
+
+void add_synthetic_cases(vector<Case> &cases)
+{
+	// random sparse sets, from a fixed seed so that every run gets the same sets
+	uint32_t seed = 12345;
+	static const unsigned sizes[] = { 64, 1024, 16384 };
+	for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		codevalue_vector codes;
+		for (unsigned i = 0; i < sizes[s]; ++i)
+		{
+			seed = seed * 1103515245 + 12345;
+			codes.push_back((seed >> 8) % (max_codevalue + 1));
+		}
+		stringstream name;
+		name << "random-" << sizes[s];
+		cases.push_back(synthetic_case(name.str(), codes));
+	}
+
+	// alternating codevalues, where no two codevalues of the set share a block
+	static const codevalue ends[] = { 0x10000, max_codevalue + 1 };
+	for (unsigned e = 0; e < sizeof(ends) / sizeof(ends[0]); ++e)
+	{
+		codevalue_vector codes;
+		for (codevalue c = 0; c < ends[e]; c += 2) codes.push_back(c);
+		cases.push_back(synthetic_case(ends[e] == 0x10000 ? "alternating-bmp" : "alternating-all", codes));
+	}
+}
+
+void run(Case &c, UnicodeData &data)
+{
+	double t0 = wall_clock();
+	auto_ptr<range_list> ranges(c.synthetic ? new range_list(c.ranges) : data.filter_multiple_gc(c.name.c_str()));
+	double t1 = wall_clock();
+	MatchTree tree(*ranges);
+	double t2 = wall_clock();
+	Predicate predicate;
+	c.compare_jumps = tree.create_predicate(predicate);
+	double t3 = wall_clock();
+
+	c.samples[Case::filter_stage].add(t1 - t0);
+	c.samples[Case::tree_stage].add(t2 - t1);
+	c.samples[Case::predicate_stage].add(t3 - t2);
+}
+
+
+//----- Output ----------------------------------------------------------------
+
+void print_header()
+{
+	cout << left << setw(12) << "group" << setw(20) << "case" << right << setw(10) << "cmp/jmp";
+	for (int s = 0; s < Case::stages; ++s) cout << setw(14) << stage_names[s] << setw(8) << "mad";
+	cout << endl;
+}
+
+void print_times(const Samples *samples)	// median ms, and mad as a percentage of the median
+{
+	for (int s = 0; s < Case::stages; ++s)
+	{
+		double m = samples[s].median();
+		cout << setw(14) << setprecision(3) << m / 1000 << setw(7) << setprecision(1) << (m > 0 ? 100 * samples[s].mad() / m : 0) << "%";
+	}
+	cout << endl;
+}
+
+void print_case(const Case &c)
+{
+	cout << left << setw(12) << c.group << setw(20) << c.name << right << setw(10) << c.compare_jumps;
+	print_times(c.samples);
+}
+
+void print_total(const vector<Case> &cases, string group)	// the sum of all the cases of the group, per repetition
+{
+	Samples total[Case::stages];
+	unsigned compare_jumps = 0, n = 0;
+	for (vector<Case>::const_iterator i = cases.begin(); i != cases.end(); ++i)
+	{
+		if (i->group != group) continue;
+		compare_jumps += i->compare_jumps;
+		for (int s = 0; s < Case::stages; ++s)
+		{
+			const vector<double> &t = i->samples[s].times;
+			if (total[s].times.size() < t.size()) total[s].times.resize(t.size(), 0);
+			for (size_t r = 0; r < t.size(); ++r) total[s].times[r] += t[r];
+		}
+		++n;
+	}
+
+	stringstream name;
+	name << "total (" << n << ")";
+	cout << left << setw(12) << group << setw(20) << name.str() << right << setw(10) << compare_jumps;
+	print_times(total);
+}
+
+
+//----- main ------------------------------------------------------------------
+
+int main(int argc, char * const argv[])
+{
+	unsigned repetitions = 9;
+	bool verbose = false;
+	string data_filename("./UnicodeData.txt");
+
+	int c;
+	while ((c = getopt(argc, argv, "vn:u:")) != -1)
+	{
+		switch (c)
+		{
+			case 'v':
+				verbose = true;
+				break;
+			case 'n':
+				repetitions = strtoul(optarg, 0, 10);
+				if (repetitions == 0) repetitions = 1;
+				break;
+			case 'u':
+				data_filename = optarg;
+				break;
+			default:
+				cerr << "usage: uniclasser_benchmark [-v] [-n repetitions] [-u path]" << endl;
+				return 1;
+		}
+	}
+
+	cout << fixed;
+
+	// loading is timed on its own, and the last of the loaded data is used for the cases
+	Samples load;
+	auto_ptr<UnicodeData> data;
+	for (unsigned r = 0; r < repetitions; ++r)
+	{
+		double t = wall_clock();
+		data.reset(new UnicodeData(data_filename));
+		load.add(wall_clock() - t);
+	}
+	if (data->count() == 0) return 1;
+	cout << "Loaded " << data->count() << " codevalues from " << data_filename << " in " << setprecision(3) << load.median() / 1000 << " ms (median of "
+		 << repetitions << ", min " << load.min() / 1000 << " ms, mad " << setprecision(1) << 100 * load.mad() / load.median() << "%)." << endl << endl;
+
+	vector<string> categories;
+	for (map<wstring, UnicodeData::property_t>::iterator i = data->gc_map.begin(); i != data->gc_map.end(); ++i)
+		categories.push_back(string(i->first.begin(), i->first.end()));
+
+	vector<Case> cases;
+	for (vector<string>::iterator i = categories.begin(); i != categories.end(); ++i) cases.push_back(Case("category", *i));
+	for (vector<string>::iterator i = categories.begin(); i != categories.end(); ++i)
+		for (vector<string>::iterator j = i + 1; j != categories.end(); ++j) cases.push_back(Case("pair", *i + "," + *j));
+	add_synthetic_cases(cases);
+
+	// one warm-up run, and then the repetitions interleaved over all the cases,
+	// so that a slow period of the machine is spread over all of them
+	for (vector<Case>::iterator i = cases.begin(); i != cases.end(); ++i)
+	{
+		run(*i, *data);
+		for (int s = 0; s < Case::stages; ++s) i->samples[s].times.clear();
+	}
+	for (unsigned r = 0; r < repetitions; ++r)
+		for (vector<Case>::iterator i = cases.begin(); i != cases.end(); ++i) run(*i, *data);
+
+	cout << "Median milliseconds of " << repetitions << " repetitions, and median absolute deviation:" << endl;
+	print_header();
+	for (vector<Case>::iterator i = cases.begin(); i != cases.end(); ++i)
+		if (verbose || i->group != "pair") print_case(*i);
+
+	cout << endl;
+	print_total(cases, "category");
+	print_total(cases, "pair");
+	print_total(cases, "synthetic");
+
+	return 0;
+}
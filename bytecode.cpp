@@ -0,0 +1,365 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include <iostream>
+#include <cstring>
+#include "bytecode.hpp"
+#include "cache.hpp"
+
+using namespace std;
+
+
+//----- visit() methods -------------------------------------------------------
+
+void BytecodeCompiler::visit(IPredicate &predicate)
+{
+	predicate.accept(*this); // cause predicate to call visit() again with the proper class as argument
+}
+
+void BytecodeCompiler::visit(TerminalPredicate &predicate)
+{
+	++nodes;
+	bool eq = predicate.should_succeed;
+	codevalue m = predicate.tested_bits, v = predicate.tested_value & m;
+
+	if (m == 0)
+	{
+		// a constant needs no test at all, just a jump to the proper target
+		target = eq ? on_match : on_miss;
+		return;
+	}
+
+	bc_instruction i;
+	i.op = BC_TEST;
+	i.a = (uint32_t)m;
+	i.b = (uint32_t)v;
+	i.match = eq ? on_match : on_miss;
+	i.miss = eq ? on_miss : on_match;
+	code.push_back(i);
+	target = code.size() - 1;
+}
+
+void BytecodeCompiler::visit(TablePredicate &predicate)
+{
+	++nodes;
+	
+	// the bitmap goes first, packed in little endian 32-bit words
+	uint32_t n = bc_table_data(predicate.size);
+	vector<uint32_t> words(n * 4, 0);
+	for (size_t i = 0, e = predicate.bits.size(); i < e; ++i) words[i / 4] |= (uint32_t)predicate.bits[i] << (8 * (i % 4));
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		bc_instruction data = { BC_DATA, words[4*i], words[4*i+1], words[4*i+2], words[4*i+3] };
+		code.push_back(data);
+	}
+	
+	bc_instruction i;
+	i.op = BC_TABLE;
+	i.a = (uint32_t)predicate.base;
+	i.b = (uint32_t)predicate.size;
+	i.match = on_match;
+	i.miss = on_miss;
+	code.push_back(i);
+	target = code.size() - 1;
+}
+
+void BytecodeCompiler::visit(RangePredicate &predicate)
+{
+	++nodes;
+	bc_instruction i;
+	i.op = BC_RANGE;
+	i.a = (uint32_t)predicate.first;
+	i.b = (uint32_t)predicate.size;
+	i.match = on_match;
+	i.miss = on_miss;
+	code.push_back(i);
+	target = code.size() - 1;
+}
+
+void BytecodeCompiler::visit(HashPredicate &predicate)
+{
+	++nodes;
+	
+	// the displacements and slots go first, four in every data instruction
+	uint32_t b = predicate.shift | (uint32_t)predicate.slots.size() << 8, n = bc_hash_data(b);
+	vector<uint32_t> words(predicate.displacements);
+	words.insert(words.end(), predicate.slots.begin(), predicate.slots.end());
+	words.resize(n * 4, predicate.slots[0]);
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		bc_instruction data = { BC_DATA, words[4*i], words[4*i+1], words[4*i+2], words[4*i+3] };
+		code.push_back(data);
+	}
+	
+	bc_instruction i;
+	i.op = BC_HASH;
+	i.a = predicate.multiplier;
+	i.b = b;
+	i.match = on_match;
+	i.miss = on_miss;
+	code.push_back(i);
+	target = code.size() - 1;
+}
+
+void BytecodeCompiler::visit(AndPredicate &predicate)
+{
+	++nodes;
+	uint32_t rhs = compile(*predicate.rhs, on_match, on_miss);
+	target = compile(*predicate.lhs, rhs, on_miss);
+}
+
+void BytecodeCompiler::visit(OrPredicate &predicate)
+{
+	++nodes;
+	uint32_t rhs = compile(*predicate.rhs, on_match, on_miss);
+	target = compile(*predicate.lhs, on_match, rhs);
+}
+
+void BytecodeCompiler::visit(TernaryPredicate &predicate)
+{
+	++nodes;
+	uint32_t on = compile(*predicate.on, on_match, on_miss);
+	uint32_t off = compile(*predicate.off, on_match, on_miss);
+	target = compile(*predicate.predicate, on, off);
+}
+
+
+//----- compile() -------------------------------------------------------------
+
+uint32_t BytecodeCompiler::compile(IPredicate &predicate, uint32_t match, uint32_t miss)
+{
+	uint32_t m = on_match, n = on_miss;
+	on_match = match;
+	on_miss = miss;
+	predicate.accept(*this);
+	on_match = m;
+	on_miss = n;
+	return target;
+}
+
+void BytecodeCompiler::generate(string classer_name, Predicate &p, range_list *test_ranges, bool profiler, Predicate *bmp_predicate, SimdKernel *simd, range_list *dont_care)
+{
+	code.clear();
+	nodes = 0;
+	entry = compile(p, BC_ACCEPT, BC_REJECT);
+}
+
+
+//----- BytecodeGenerator -----------------------------------------------------
+
+string BytecodeGenerator::serialize()
+{
+	bc_header h;
+	memcpy(h.magic, BC_MAGIC, sizeof(h.magic));
+	h.version = BC_VERSION;
+	h.count = code.size();
+	h.entry = entry;
+
+	string s((const char *)&h, sizeof(h));
+	if (!code.empty()) s.append((const char *)&code[0], code.size() * sizeof(bc_instruction));
+	return s;
+}
+
+void BytecodeGenerator::generate(string classer_name, Predicate &p, range_list *test_ranges, bool profiler, Predicate *bmp_predicate, SimdKernel *simd, range_list *dont_care)
+{
+	classers.push_back(classer_name);
+	generated.clear();
+
+	BytecodeCompiler::generate(classer_name, p);
+	cout << "Compiled " << nodes << " predicate nodes into " << code.size() << " instructions." << endl;
+
+	generated.push_back(make_pair(classer_name + ".ucb", serialize()));
+	out_write(generated.back().first, generated.back().second, "classifier bytecode");
+}
+
+void BytecodeGenerator::generate_c_interpreter()
+{
+	out << "// Autogenerated by the uniclasser generator. See " << URL << endl
+		<< "// Permission is hereby granted to include, modify, republish and resell this code for any purpose." << endl << endl
+		<< "#ifndef UNICLASSER_BC_H" << endl
+		<< "#define UNICLASSER_BC_H" << endl
+		<< endl
+		<< "#include <stddef.h>" << endl
+		<< "#include <stdint.h>" << endl
+		<< endl
+		<< "#define UCB_VERSION " << BC_VERSION << endl
+		<< "#define UCB_REJECT 0x" << hex << BC_REJECT << 'u' << endl
+		<< "#define UCB_ACCEPT 0x" << BC_ACCEPT << 'u' << dec << endl
+		<< "#define UCB_TEST " << BC_TEST << endl
+		<< "#define UCB_TABLE " << BC_TABLE << endl
+		<< "#define UCB_DATA " << BC_DATA << endl
+		<< "#define UCB_RANGE " << BC_RANGE << endl
+		<< "#define UCB_HASH " << BC_HASH << endl
+		<< "#define UCB_TABLE_DATA(size) (((size) + 127) / 128)	// data instructions before a table" << endl
+		<< "#define UCB_HASH_BUCKETS(b) (1u << (32 - ((b) & 0xFF)))	// displacements of a hash, followed by its b >> 8 slots" << endl
+		<< "#define UCB_HASH_DATA(b) ((UCB_HASH_BUCKETS(b) + ((b) >> 8) + 3) / 4)	// data instructions before a hash" << endl
+		<< "#define UCB_HASH_OK(b) (((b) & 0xFF) >= 16 && ((b) & 0xFF) < 32 && ((b) >> 8) >= 1 && ((b) >> 8) <= 0x10000)" << endl
+		<< "#define UCB_JUMP_OK(to, i) ((to) >= UCB_REJECT || ((to) < (i) && code[to].op != UCB_DATA))" << endl
+		<< endl
+		<< "typedef struct { char magic[4]; uint32_t version, count, entry; } ucb_header;" << endl
+		<< "typedef struct { uint32_t op, a, b, match, miss; } ucb_instruction;" << endl
+		<< endl
+		<< "// Returns the program held in the size bytes at blob (e.g. an mmap'd .ucb file)," << endl
+		<< "// or 0 if it is not a valid program. Validate once, then call ucb_match() freely." << endl
+		<< "static inline const ucb_header *ucb_program(const void *blob, size_t size)" << endl
+		<< '{' << endl
+		<< "	const ucb_header *h = (const ucb_header *)blob;" << endl
+		<< "	const ucb_instruction *code = (const ucb_instruction *)(h + 1);" << endl
+		<< "	uint32_t i, j, n;" << endl
+		<< "	if (size < sizeof(ucb_header) || h->magic[0] != 'U' || h->magic[1] != 'C' || h->magic[2] != 'B' || h->magic[3] != '1') return 0;" << endl
+		<< "	if (h->version != UCB_VERSION || h->count > (size - sizeof(ucb_header)) / sizeof(ucb_instruction)) return 0;" << endl
+		<< "	if (!UCB_JUMP_OK(h->entry, h->count)) return 0;" << endl
+		<< "	for (i = 0; i < h->count; ++i)	// jumps must point backward, which guarantees termination" << endl
+		<< "	{" << endl
+		<< "		if (code[i].op == UCB_DATA) continue;" << endl
+		<< "		if (code[i].op == UCB_TEST || code[i].op == UCB_RANGE) n = 0;" << endl
+		<< "		else if (code[i].op == UCB_TABLE && code[i].b <= 0x200000) n = UCB_TABLE_DATA(code[i].b);" << endl
+		<< "		else if (code[i].op == UCB_HASH && UCB_HASH_OK(code[i].b)) n = UCB_HASH_DATA(code[i].b);" << endl
+		<< "		else return 0;" << endl
+		<< "		if (!UCB_JUMP_OK(code[i].match, i) || !UCB_JUMP_OK(code[i].miss, i) || n > i) return 0;" << endl
+		<< "		for (j = i - n; j < i; ++j) if (code[j].op != UCB_DATA) return 0;	// the data of a table or a hash" << endl
+		<< "	}" << endl
+		<< "	return h;" << endl
+		<< '}' << endl
+		<< endl
+		<< "static inline int ucb_match(const ucb_header *program, uint32_t c)" << endl
+		<< '{' << endl
+		<< "	const ucb_instruction *code = (const ucb_instruction *)(program + 1), *i;" << endl
+		<< "	const ucb_instruction *data;" << endl
+		<< "	uint32_t pc = program->entry, d;" << endl
+		<< "	while (pc < UCB_REJECT)" << endl
+		<< "	{" << endl
+		<< "		i = code + pc;" << endl
+		<< "		if (i->op == UCB_TEST) pc = (c & i->a) == i->b ? i->match : i->miss;" << endl
+		<< "		else if (i->op == UCB_RANGE) pc = c - i->a < i->b ? i->match : i->miss;" << endl
+		<< "		else if (i->op == UCB_HASH)" << endl
+		<< "		{" << endl
+		<< "			data = i - UCB_HASH_DATA(i->b);" << endl
+		<< "			d = c * i->a >> (i->b & 0xFF);" << endl
+		<< "			d = (&data[d >> 2].a)[d & 3];" << endl
+		<< "			d = UCB_HASH_BUCKETS(i->b) + (uint32_t)((uint64_t)((c ^ d) * i->a) * (i->b >> 8) >> 32);" << endl
+		<< "			pc = (&data[d >> 2].a)[d & 3] == c ? i->match : i->miss;" << endl
+		<< "		}" << endl
+		<< "		else" << endl
+		<< "		{" << endl
+		<< "			d = c - i->a;" << endl
+		<< "			pc = d < i->b && ((&(i - UCB_TABLE_DATA(i->b))[d >> 7].a)[(d >> 5) & 3] >> (d & 31) & 1) ? i->match : i->miss;" << endl
+		<< "		}" << endl
+		<< "	}" << endl
+		<< "	return pc == UCB_ACCEPT;" << endl
+		<< '}' << endl
+		<< endl
+		<< "#endif";
+}
+
+void BytecodeGenerator::generate_cpp_interpreter()
+{
+	out << "// Autogenerated by the uniclasser generator. See " << URL << endl
+		<< "// Permission is hereby granted to include, modify, republish and resell this code for any purpose." << endl << endl
+		<< "#ifndef UNICLASSER_BC_HPP" << endl
+		<< "#define UNICLASSER_BC_HPP" << endl
+		<< endl
+		<< "#include <cstddef>" << endl
+		<< "#include <stdint.h>" << endl
+		<< endl
+		<< "// Runs a classifier program held in memory (e.g. an mmap'd .ucb file). The" << endl
+		<< "// program is validated once by the constructor; check valid() before use." << endl
+		<< "struct BytecodeClassifier" << endl
+		<< '{' << endl
+		<< "	struct instruction { uint32_t op, a, b, match, miss; };" << endl
+		<< "	struct header { char magic[4]; uint32_t version, count, entry; };" << endl
+		<< endl
+		<< "	enum { version = " << BC_VERSION << ", test = " << BC_TEST << ", table = " << BC_TABLE << ", data = " << BC_DATA << ", range = " << BC_RANGE << ", hash = " << BC_HASH << " };" << endl
+		<< "	static const uint32_t reject = 0x" << hex << BC_REJECT << "u, accept = 0x" << BC_ACCEPT << "u;" << dec << endl
+		<< endl
+		<< "	BytecodeClassifier(const void *blob, std::size_t size) : code(0), entry(reject)" << endl
+		<< "	{" << endl
+		<< "		const header *h = static_cast<const header *>(blob);" << endl
+		<< "		const instruction *c = reinterpret_cast<const instruction *>(h + 1);" << endl
+		<< "		if (size < sizeof(header) || h->magic[0] != 'U' || h->magic[1] != 'C' || h->magic[2] != 'B' || h->magic[3] != '1') return;" << endl
+		<< "		if (h->version != version || h->count > (size - sizeof(header)) / sizeof(instruction)) return;" << endl
+		<< "		if (!jump_ok(c, h->entry, h->count)) return;" << endl
+		<< "		for (uint32_t i = 0; i < h->count; ++i)	// jumps must point backward, which guarantees termination" << endl
+		<< "		{" << endl
+		<< "			if (c[i].op == data) continue;" << endl
+		<< "			uint32_t n;" << endl
+		<< "			if (c[i].op == test || c[i].op == range) n = 0;" << endl
+		<< "			else if (c[i].op == table && c[i].b <= 0x200000) n = table_data(c[i].b);" << endl
+		<< "			else if (c[i].op == hash && hash_ok(c[i].b)) n = hash_data(c[i].b);" << endl
+		<< "			else return;" << endl
+		<< "			if (!jump_ok(c, c[i].match, i) || !jump_ok(c, c[i].miss, i) || n > i) return;" << endl
+		<< "			for (uint32_t j = i - n; j < i; ++j) if (c[j].op != data) return;	// the data of a table or a hash" << endl
+		<< "		}" << endl
+		<< "		code = c;" << endl
+		<< "		entry = h->entry;" << endl
+		<< "	}" << endl
+		<< endl
+		<< "	bool valid() const { return code != 0; }" << endl
+		<< endl
+		<< "	static uint32_t table_data(uint32_t size) { return (size + 127) / 128; }	// data instructions before a table" << endl
+		<< "	static uint32_t hash_buckets(uint32_t b) { return 1u << (32 - (b & 0xFF)); }	// displacements of a hash, followed by its b >> 8 slots" << endl
+		<< "	static uint32_t hash_data(uint32_t b) { return (hash_buckets(b) + (b >> 8) + 3) / 4; }	// data instructions before a hash" << endl
+		<< "	static bool hash_ok(uint32_t b) { return (b & 0xFF) >= 16 && (b & 0xFF) < 32 && (b >> 8) >= 1 && (b >> 8) <= 0x10000; }" << endl
+		<< "	static bool jump_ok(const instruction *c, uint32_t to, uint32_t from) { return to >= reject || (to < from && c[to].op != data); }" << endl
+		<< endl
+		<< "	bool operator()(uint32_t c) const" << endl
+		<< "	{" << endl
+		<< "		uint32_t pc = entry;" << endl
+		<< "		while (pc < reject)" << endl
+		<< "		{" << endl
+		<< "			const instruction &i = code[pc];" << endl
+		<< "			if (i.op == test) pc = (c & i.a) == i.b ? i.match : i.miss;" << endl
+		<< "			else if (i.op == range) pc = c - i.a < i.b ? i.match : i.miss;" << endl
+		<< "			else if (i.op == hash)" << endl
+		<< "			{" << endl
+		<< "				const instruction *data = &i - hash_data(i.b);" << endl
+		<< "				uint32_t d = c * i.a >> (i.b & 0xFF);" << endl
+		<< "				d = (&data[d >> 2].a)[d & 3];" << endl
+		<< "				d = hash_buckets(i.b) + (uint32_t)((uint64_t)((c ^ d) * i.a) * (i.b >> 8) >> 32);" << endl
+		<< "				pc = (&data[d >> 2].a)[d & 3] == c ? i.match : i.miss;" << endl
+		<< "			}" << endl
+		<< "			else" << endl
+		<< "			{" << endl
+		<< "				uint32_t d = c - i.a;" << endl
+		<< "				pc = d < i.b && ((&(&i - table_data(i.b))[d >> 7].a)[(d >> 5) & 3] >> (d & 31) & 1) ? i.match : i.miss;" << endl
+		<< "			}" << endl
+		<< "		}" << endl
+		<< "		return pc == accept;" << endl
+		<< "	}" << endl
+		<< endl
+		<< "	const instruction *code;" << endl
+		<< "	uint32_t entry;" << endl
+		<< "};" << endl
+		<< endl
+		<< "#endif";
+}
+
+void BytecodeGenerator::out_write(string filename, const string &content, const char * const what)
+{
+	bool written = write_if_changed(output_dir + filename, content);
+	if (what == 0) return;
+	if (written) cout << "Writing " << what << " to " << output_dir << filename << endl;
+	else cout << output_dir << filename << " is unchanged (" << what << ")" << endl;
+}
+
+void BytecodeGenerator::restore(string classer_name, generated_files &files)
+{
+	classers.push_back(classer_name);
+	
+	for (generated_files::const_iterator i = files.begin(), e = files.end(); i != e; ++i)
+		out_write(i->first, i->second, "cached file");
+}
+
+void BytecodeGenerator::finalize(bool test, bool profiler)
+{
+	if (test) cout << "Note: no test suite is generated for bytecode classifiers." << endl;
+
+	out.str("");
+	generate_c_interpreter();
+	out_write("uniclasser_bc.h", out.str(), "C bytecode interpreter");
+
+	out.str("");
+	generate_cpp_interpreter();
+	out_write("uniclasser_bc.hpp", out.str(), "C++ bytecode interpreter");
+}
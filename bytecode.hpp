@@ -0,0 +1,157 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdint.h>
+#include "generator.hpp"
+
+
+//----- Instructions ----------------------------------------------------------
+
+// A classifier program is a flat array of instructions, each performing a
+// single compare/jump. Evaluation starts at the entry instruction, and
+// follows the match or miss target of every instruction until it reaches
+// one of the two terminal targets, which decide the result.
+//
+// The bitmap of a table, or the displacements and slots of a hash, are held
+// by the BC_DATA instructions right before its BC_TABLE or BC_HASH
+// instruction, four 32-bit words (a, b, match, miss) in each. Data
+// instructions are never evaluated.
+
+enum
+{
+	BC_TEST = 0,	// matches if (c & a) == b
+	BC_TABLE = 1,	// matches if c - a < b, and bit c - a of the table's bitmap is set
+	BC_DATA = 2,	// holds four words of a table's bitmap
+	BC_RANGE = 3,	// matches if c - a < b
+	BC_HASH = 4		// matches if c equals its slot of the hash (see bc_hash_match())
+};
+
+static const uint32_t BC_REJECT = 0xFFFFFFFE, BC_ACCEPT = 0xFFFFFFFF;
+
+struct bc_instruction
+{
+	uint32_t op, a, b;
+	uint32_t match, miss;	// index of next instruction, or BC_ACCEPT / BC_REJECT
+};
+
+typedef std::vector<bc_instruction> bc_program;
+
+inline uint32_t bc_table_data(uint32_t size) { return (size + 127) / 128; }	// data instructions of a table of size bits
+
+inline bool bc_table_match(const bc_instruction *table, uint32_t c)
+{
+	uint32_t d = c - table->a;
+	if (d >= table->b) return false;
+	const bc_instruction &data = (table - bc_table_data(table->b))[d >> 7];
+	return (&data.a)[(d >> 5) & 3] >> (d & 31) & 1;
+}
+
+// The b of a hash holds its shift in the low byte, and its number of slots
+// above it. The 1 << (32 - shift) displacements come first in its data.
+inline uint32_t bc_hash_buckets(uint32_t b) { return 1u << (32 - (b & 0xFF)); }
+inline uint32_t bc_hash_data(uint32_t b) { return (bc_hash_buckets(b) + (b >> 8) + 3) / 4; }	// data instructions of a hash
+
+inline bool bc_hash_match(const bc_instruction *hash, uint32_t c)
+{
+	const bc_instruction *data = hash - bc_hash_data(hash->b);
+	uint32_t s = c * hash->a >> (hash->b & 0xFF);
+	uint32_t d = (&data[s >> 2].a)[s & 3];
+	s = bc_hash_buckets(hash->b) + (uint32_t)((uint64_t)((c ^ d) * hash->a) * (hash->b >> 8) >> 32);
+	return (&data[s >> 2].a)[s & 3] == c;
+}
+
+inline bool bc_match(const bc_instruction *i, uint32_t c)
+{
+	if (i->op == BC_TEST) return (c & i->a) == i->b;
+	else if (i->op == BC_RANGE) return c - i->a < i->b;
+	else if (i->op == BC_HASH) return bc_hash_match(i, c);
+	else return bc_table_match(i, c);
+}
+
+
+//----- Serialized programs ---------------------------------------------------
+
+// A serialized program is a bc_header followed by its instructions, in the
+// native byte order. All jumps in a valid program point backward (children
+// are compiled before their parents), so a program that passes validation
+// always terminates, and needs no bounds checks while it runs.
+
+#define BC_MAGIC "UCB1"
+
+static const uint32_t BC_VERSION = 5;
+
+struct bc_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t count;		// number of instructions
+	uint32_t entry;		// first instruction to evaluate, or BC_ACCEPT / BC_REJECT
+};
+
+
+//----- BytecodeCompiler ------------------------------------------------------
+
+// Lowers a predicate into a bc_program. Since every predicate node knows where
+// to go when it matches and when it does not, the program is built bottom-up:
+// the children of a node are compiled first, and their entries become the
+// jump targets of the node's own test.
+struct BytecodeCompiler : public IGenerator
+{
+	BytecodeCompiler() : entry(BC_REJECT), nodes(0) {}
+
+	virtual void visit(IPredicate &predicate);
+	virtual void visit(TerminalPredicate &predicate);
+	virtual void visit(AndPredicate &predicate);
+	virtual void visit(OrPredicate &predicate);
+	virtual void visit(TernaryPredicate &predicate);
+	virtual void visit(TablePredicate &predicate);
+	virtual void visit(RangePredicate &predicate);
+	virtual void visit(HashPredicate &predicate);
+
+	virtual void generate(std::string classer_name, Predicate &p, range_list *test_ranges = 0, bool profiler = false, Predicate *bmp_predicate = 0, SimdKernel *simd = 0, range_list *dont_care = 0);
+	virtual void restore(std::string classer_name, generated_files &files) {}
+	virtual generated_files& last_generated() { return generated; }
+	virtual void finalize(bool test, bool profiler) {}
+
+	uint32_t compile(IPredicate &predicate, uint32_t on_match, uint32_t on_miss);
+
+	bc_program code;
+	uint32_t entry;
+	unsigned nodes;		// number of predicate nodes lowered so far
+
+	uint32_t on_match, on_miss, target;	// state of the compile() in progress
+	generated_files generated;
+};
+
+
+//----- BytecodeGenerator -----------------------------------------------------
+
+// Writes every classifier as a serialized program (uniclasser_X.ucb), plus
+// dependency free interpreters for C (uniclasser_bc.h) and C++ (uniclasser_bc.hpp)
+// that run such programs straight from memory, e.g. from an mmap'd file.
+struct BytecodeGenerator : public BytecodeCompiler
+{
+	BytecodeGenerator(std::string output_dir) : output_dir(output_dir) {}
+
+	virtual void generate(std::string classer_name, Predicate &p, range_list *test_ranges = 0, bool profiler = false, Predicate *bmp_predicate = 0, SimdKernel *simd = 0, range_list *dont_care = 0);
+	std::string serialize();
+	void generate_c_interpreter();
+	void generate_cpp_interpreter();
+	virtual void restore(std::string classer_name, generated_files &files);
+	virtual void finalize(bool test, bool profiler);
+
+	void out_write(std::string filename, const std::string &content, const char * const what = 0);
+
+	std::string output_dir;
+	std::vector<std::string> classers;
+	std::ostringstream out;
+};
+
+#endif
@@ -3,7 +3,13 @@
 // Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
 
 #include <iostream>
+#include <cctype>
 #include "c_generator.hpp"
+#include "cache.hpp"
+#include "class_table.hpp"
+#include "simd_kernel.hpp"
+#include "match_tree.hpp"
+#include "table_blob.hpp"
 
 using namespace std;
 
@@ -24,7 +30,7 @@ void CGenerator::visit(TerminalPredicate &predicate)
 	
 	if (m == 0)
 	{
-		out << eq;
+		out << (eq ? 1 : 0);	// C has no true and false without stdbool.h
 	}
 	else if (v == 0)
 	{
@@ -47,7 +53,15 @@ void CGenerator::visit(AndPredicate &predicate)
 {
 	PROFILE(JA, predicate.lhs->accept(*this))
 	out << "&&" << endl << prefix;
-	PROFILE(JR, predicate.rhs->accept(*this))
+	TerminalPredicate *test = dynamic_cast<TerminalPredicate*>(predicate.lhs);	// the rhs is only reached when it succeeds
+	if (test != 0 && test->should_succeed)
+	{
+		PROFILE(JR, visit_branch(*predicate.rhs, test->tested_bits, test->tested_value))
+	}
+	else
+	{
+		PROFILE(JR, predicate.rhs->accept(*this))
+	}
 }
 
 void CGenerator::visit(OrPredicate &predicate)
@@ -67,13 +81,57 @@ void CGenerator::visit(TernaryPredicate &predicate)
 	PROFILE(JA, predicate.predicate->accept(*this))
 	out << endl << prefix << "?\t";
 	prefix += '\t';
-	predicate.on->accept(*this);
+	codevalue bit = ((TerminalPredicate*)predicate.predicate)->tested_bits;	// the on branch is taken when bit is clear
+	visit_branch(*predicate.on, bit, 0);
 	out << endl << prefix.substr(0, prefix.length()-1) << ":\t";
-	predicate.off->accept(*this);
+	visit_branch(*predicate.off, bit, bit);
 	prefix.erase(prefix.length()-1);
 	out << endl << prefix << ')';
 }
 
+void CGenerator::visit(TablePredicate &predicate)
+{
+	// the table itself is written before the function that uses it, by out_with_tables()
+	ostringstream name;
+	name << table_prefix << "_table" << table_count++;
+	write_table(tables, blob, "unsigned char", name.str(), predicate.bits);
+	
+	codevalue b = predicate.base;
+	out << "((unsigned)(c-" << b << ")<" << predicate.size << "&&" << name.str() << "[(c-" << b << ")>>3]>>((c-" << b << ")&7)&1)";
+}
+
+void CGenerator::visit(RangePredicate &predicate)
+{
+	out << "((unsigned)(c-" << predicate.first << ")<" << predicate.size << ')';
+}
+
+void CGenerator::visit_branch(IPredicate &predicate, codevalue bits, codevalue value)
+{
+	uint32_t outer_bits = known_bits, outer_value = known_value;
+	known_bits |= bits;
+	known_value = (known_value & ~(uint32_t)bits) | (value & bits);
+	
+	// a subtree is cold when a bit above the BMP is known to be set, and only
+	// subtrees of more than a single compare are worth a call
+	bool single = dynamic_cast<TerminalPredicate*>(&predicate) || dynamic_cast<RangePredicate*>(&predicate) || dynamic_cast<HashPredicate*>(&predicate);
+	if (split_cold && !in_cold && !single && (known_bits & known_value & ~0xffffu) != 0) generate_cold(predicate);
+	else predicate.accept(*this);
+	
+	known_bits = outer_bits;
+	known_value = outer_value;
+}
+
+void CGenerator::visit(HashPredicate &predicate)
+{
+	ostringstream name;
+	name << table_prefix << "_hash" << table_count++;
+	write_table(tables, blob, "unsigned", name.str() + "_disp", predicate.displacements);
+	write_table(tables, blob, "unsigned", name.str(), predicate.slots);
+	
+	// slot = ((c ^ displacement) * multiplier) scaled to the number of slots
+	out << "((unsigned)c==" << name.str() << "[(unsigned long long)(((unsigned)c^" << name.str() << "_disp[(unsigned)c*" << predicate.multiplier << ">>" << predicate.shift << "])*" << predicate.multiplier << ")*" << predicate.slots.size() << ">>32])";
+}
+
 
 //----- generate() methods ----------------------------------------------------
 
@@ -87,8 +145,14 @@ void CGenerator::generate_main(bool test, bool profiler)
 	out	<< endl
 		<< "int main (int argc, char * const argv[])" << endl
 		<< '{'
-		<< "	" << endl
-		<< "	if (argc > 1) for (int i = 1; i < argc; ++i)" << endl
+		<< "	" << endl;
+	if (blob != 0)
+		out << "	if (!uniclasser_load_tables(\"" << blob->filename << "\"))" << endl
+			<< "	{" << endl
+			<< "		printf(\"Could not load the table blob " << blob->filename << "\\n\");" << endl
+			<< "		return 1;" << endl
+			<< "	}" << endl;
+	out	<< "	if (argc > 1) for (int i = 1; i < argc; ++i)" << endl
 		<< "	{" << endl
 		<< "		wchar_t c;" << endl
 		<< "		if (mbtowc(&c, argv[i], strlen(argv[i])) > 0)" << endl
@@ -118,9 +182,41 @@ void CGenerator::generate_main(bool test, bool profiler)
 #define QUOTEMACRO(x) QUOTEMACRO_(x)
 #define QCODEVALUE QUOTEMACRO(CODEVALUE)
 
+string CGenerator::codevalue_type()
+{
+	// narrower classifiers take the narrowest type that holds their codevalues
+	return width <= 16 ? "unsigned short" : width < 32 ? "unsigned" : QCODEVALUE;
+}
+
+string CGenerator::linkage(bool internal)
+{
+	// header-only classifiers are static inline, so that every caller can inline them
+	return header_only ? "UNICLASSER_INLINE " : internal ? "static " : "";
+}
+
 void CGenerator::generate_classer(string classer_name, IPredicate &predicate, bool profiler)
 {
-	out << "#include \"uniclasser.h\"" << endl << endl << showbase << boolalpha;
+	if (header_only)
+	{
+		string guard(classer_name);
+		for (string::iterator i = guard.begin(); i != guard.end(); ++i) *i = toupper(*i);
+		out << "#ifndef " << guard << "_H" << endl
+			<< "#define " << guard << "_H" << endl
+			<< endl
+			<< "#include <stddef.h>" << endl
+			<< endl
+			<< "#ifndef UNICLASSER_INLINE" << endl
+			<< "#if defined(__GNUC__)" << endl
+			<< "#define UNICLASSER_INLINE static inline __attribute__((hot))" << endl
+			<< "#else" << endl
+			<< "#define UNICLASSER_INLINE static inline" << endl
+			<< "#endif" << endl
+			<< "#endif" << endl
+			<< endl;
+		if (blob != 0) out << "extern const unsigned char *uniclasser_tables;" << endl << endl;
+		out << showbase << boolalpha;
+	}
+	else out << "#include \"uniclasser.h\"" << endl << endl << showbase << boolalpha;
 	
 	if (profiler)
 		out << "#define JA(x) inct() && (x) && dect()" << endl
@@ -128,7 +224,24 @@ void CGenerator::generate_classer(string classer_name, IPredicate &predicate, bo
 			<< "#define JR(x) (inct() && (x))" << endl
 			<< endl;
 	
-	out << "int " << classer_name << '(' << QCODEVALUE << " c)" << endl
+	if (split_cold)
+		out << "#ifndef UNICLASSER_COLD" << endl
+			<< "#if defined(__GNUC__)" << endl
+			<< "#define UNICLASSER_COLD static __attribute__((noinline, cold))	// in a section of its own, away from the hot code" << endl
+			<< "#else" << endl
+			<< "#define UNICLASSER_COLD static" << endl
+			<< "#endif" << endl
+			<< "#endif" << endl
+			<< endl;
+	
+	string head = out.str();
+	out.str("");
+	cold.str("");
+	cold_count = 0;
+	in_cold = false;
+	known_bits = known_value = 0;
+	
+	out << linkage() << "int " << classer_name << '(' << codevalue_type() << " c)" << endl
 	<< '{' << endl;
 	if (profiler) out << "	profiler_reset();" << endl;
 	out	<< "	return" << endl
@@ -140,49 +253,257 @@ void CGenerator::generate_classer(string classer_name, IPredicate &predicate, bo
 		<< "	;" << endl
 		<< '}' << endl
 		<< endl;
+	
+	string function = out.str();
+	out.str(head);
+	out_with_tables(cold.str() + function);
 }
 
-void CGenerator::generate_test(string classer_name, codevalue_vector &codes, bool profiler)
+void CGenerator::generate_cold(IPredicate &predicate)
 {
-	out << "#include <stdio.h>" << endl
-		<< "#include \"uniclasser.h\"" << endl << endl << showbase << boolalpha
-		<< "#define AVG(s,n) (n==0? 0 : ((float)(s)/(n)))" << endl << endl 
-		<< "void test_" << classer_name << "()" << endl
+	// the subtree becomes a function of its own, which is written before the
+	// function that calls it, and the call takes its place
+	ostringstream name;
+	name << table_prefix << "_cold" << cold_count++;
+	string outer = out.str(), outer_prefix = prefix;
+	out.str("");
+	out << "UNICLASSER_COLD int " << name.str() << '(' << codevalue_type() << " c)" << endl
 		<< '{' << endl
-		<< "	" << QCODEVALUE << " codes[] = {" << hex;
+		<< "	return" << endl
+		<< "		";
+	prefix = "\t\t";
+	in_cold = true;
+	predicate.accept(*this);
+	in_cold = false;
+	out << endl
+		<< "	;" << endl
+		<< '}' << endl
+		<< endl;
+	cold << out.str();
 	
+	out.str(outer);
+	out.seekp(0, ios_base::end);
+	prefix = outer_prefix;
+	out << name.str() << "(c)";
+}
+
+void CGenerator::generate_utf16(string classer_name, IPredicate &bmp_predicate)
+{
+	// BMP code units are classified by a predicate that covers only the BMP,
+	// and only a high surrogate leads to the supplementary planes path
+	bool profile = c_profile;
+	c_profile = false;
+	string head = out.str();
+	out.str("");
+	out << linkage(true) << "int " << classer_name << "_bmp(unsigned short c)" << endl
+		<< '{' << endl
+		<< "	return" << endl
+		<< "		" << hex;
+	prefix = "\t\t";
+	bmp_predicate.accept(*this);
+	c_profile = profile;
+	out << endl 
+		<< "	;" << endl
+		<< '}' << endl
+		<< endl
+		<< linkage() << "int " << classer_name << "_utf16(const unsigned short *s, size_t n, size_t *i)" << endl
+		<< '{' << endl
+		<< "	unsigned short u = s[(*i)++];" << endl
+		<< "	if ((u & 0xfc00) != 0xd800 || *i == n || (s[*i] & 0xfc00) != 0xdc00)" << endl
+		<< "		return " << classer_name << "_bmp(u);	// a BMP character, or an unpaired surrogate" << endl
+		<< "	return " << classer_name << "(0x10000 + ((u & 0x3ff) << 10) + (s[(*i)++] & 0x3ff));" << endl
+		<< '}' << endl
+		<< endl
+		<< linkage() << "void " << classer_name << "_utf16_batch(const unsigned short *s, size_t n, unsigned char *out)" << endl
+		<< '{' << endl
+		<< "	size_t i = 0, j;" << endl
+		<< "	unsigned char b;" << endl
+		<< "	while (i < n)" << endl
+		<< "	{" << endl
+		<< "		if ((s[i] & 0xf800) != 0xd800)" << endl
+		<< "		{" << endl
+		<< "			out[i] = " << classer_name << "_bmp(s[i]);" << endl
+		<< "			++i;" << endl
+		<< "		}" << endl
+		<< "		else" << endl
+		<< "		{" << endl
+		<< "			j = i;" << endl
+		<< "			b = " << classer_name << "_utf16(s, n, &i);" << endl
+		<< "			while (j < i) out[j++] = b;" << endl
+		<< "		}" << endl
+		<< "	}" << endl
+		<< '}' << endl
+		<< endl;
+	
+	string functions = out.str();
+	out.str(head);
+	out_with_tables(functions);
+}
+
+void CGenerator::generate_simd(string classer_name, SimdKernel &kernel)
+{
+	// the kernel is compiled for AVX2 or SSSE3, whichever the target has, and
+	// otherwise it falls back to the scalar batch entry point
+	out << dec << "#if defined(__AVX2__) || defined(__SSSE3__)" << endl
+		<< "#include <immintrin.h>" << endl
+		<< endl;
+	write_table(out, blob, "unsigned char", classer_name + "_simd_blocks", kernel.blocks);
+	write_table(out, blob, "unsigned char", classer_name + "_simd_tables", kernel.tables);
+	out << dec;
+	for (int avx2 = 1; avx2 >= 0; --avx2)
+	{
+		unsigned width = avx2 ? 32 : 16;
+		string v = avx2 ? "__m256i" : "__m128i", p = avx2 ? "_mm256_" : "_mm_", si = avx2 ? "si256" : "si128";
+		string row = avx2 ? "_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(t" : "_mm_loadu_si128((const __m128i *)(t";
+		string row_end = avx2 ? "))" : ")";
+		out << (avx2 ? "#if defined(__AVX2__)" : "#else") << endl
+			<< endl
+			<< "static inline " << v << ' ' << classer_name << "_simd_in(" << v << " x, const unsigned char *t)	// bytes of x that are in the set of t" << endl
+			<< '{' << endl
+			<< "	const " << v << " low = " << p << "set1_epi8(0x0f), high = " << p << "set1_epi8((char)0x80);" << endl
+			<< "	const " << v << " bits = " << p << "setr_epi8(";
+		for (unsigned i = 0; i < width; ++i) out << (i == 0 ? "" : ",") << (i % 8 == 7 ? -128 : 1 << (i % 8));
+		out << ");" << endl
+			<< "	" << v << " i = " << p << "and_" << si << "(x, " << p << "or_" << si << "(low, high));" << endl
+			<< "	" << v << " rows = " << p << "or_" << si << '(' << p << "shuffle_epi8(" << row << ")" << row_end << ", i), " << p << "shuffle_epi8(" << row << " + 16)" << row_end << ", " << p << "xor_" << si << "(i, high)));" << endl
+			<< "	" << v << " bit = " << p << "shuffle_epi8(bits, " << p << "and_" << si << '(' << p << "srli_epi16(x, 4), low));" << endl
+			<< "	return " << p << "cmpeq_epi8(" << p << "and_" << si << "(rows, bit), bit);" << endl
+			<< '}' << endl
+			<< endl
+			<< "static inline " << v << ' ' << classer_name << "_simd_ids(" << v << " x, const unsigned char *t)	// the ids of the blocks of the bytes of x, from the 256 ids of t" << endl
+			<< '{' << endl
+			<< "	const " << v << " low = " << p << "set1_epi8(0x0f);" << endl
+			<< "	" << v << " h = " << p << "and_" << si << '(' << p << "srli_epi16(x, 4), low), l = " << p << "and_" << si << "(x, low), id = " << p << "setzero_" << si << "();" << endl
+			<< "	int k;" << endl
+			<< "	for (k = 0; k < 16; ++k, t += 16)" << endl
+			<< "		id = " << p << "or_" << si << "(id, " << p << "and_" << si << '(' << p << "shuffle_epi8(" << row << ")" << row_end << ", l), " << p << "cmpeq_epi8(h, " << p << "set1_epi8((char)k))));" << endl
+			<< "	return id;" << endl
+			<< '}' << endl
+			<< endl
+			<< linkage() << "void " << classer_name << "_simd(const unsigned short *s, size_t n, unsigned char *out)" << endl
+			<< '{' << endl
+			<< "	const " << v << " mask = " << p << "set1_epi16(0xff), one = " << p << "set1_epi8(1);" << endl
+			<< "	const " << v << " empty = " << p << "set1_epi8(" << (unsigned)SimdKernel::empty_block << "), full = " << p << "set1_epi8(" << (unsigned)SimdKernel::full_block << "), other = " << p << "set1_epi8(" << (unsigned)SimdKernel::other_block << ");" << endl
+			<< "	const unsigned char *t = " << classer_name << "_simd_tables;" << endl
+			<< "	unsigned char ids[" << width << "];" << endl
+			<< "	size_t i = 0, j, end;" << endl
+			<< "	unsigned m, k;" << endl
+			<< "	unsigned char b;" << endl
+			<< "	while (i < n)" << endl
+			<< "	{" << endl
+			<< "		if (n - i >= " << width << ')' << endl
+			<< "		{" << endl
+			<< "			" << v << " a = " << p << "loadu_" << si << "((const " << v << " *)(s + i)), c = " << p << "loadu_" << si << "((const " << v << " *)(s + i + " << width / 2 << "));" << endl
+			<< "			" << v << " lo = " << p << "packus_epi16(" << p << "and_" << si << "(a, mask), " << p << "and_" << si << "(c, mask));" << endl
+			<< "			" << v << " hi = " << p << "packus_epi16(" << p << "srli_epi16(a, 8), " << p << "srli_epi16(c, 8));" << endl;
+		if (avx2)
+			out << "			" << v << " id, r, in;" << endl
+				<< "			lo = _mm256_permute4x64_epi64(lo, 0xd8);	// packus works within 128-bit lanes" << endl
+				<< "			hi = _mm256_permute4x64_epi64(hi, 0xd8);" << endl
+				<< "			id = " << classer_name << "_simd_ids(hi, " << classer_name << "_simd_blocks);" << endl;
+		else
+			out << "			" << v << " id = " << classer_name << "_simd_ids(hi, " << classer_name << "_simd_blocks), r, in;" << endl;
+		out << "			if (" << p << "movemask_epi8(" << p << "cmpeq_epi8(id, other)) == 0)	// no surrogates" << endl
+			<< "			{" << endl
+			<< "				// every mixed block in the chunk is looked up once, for all its code units" << endl
+			<< "				r = " << p << "cmpeq_epi8(id, full);" << endl
+			<< "				m = ~(unsigned)" << p << "movemask_epi8(" << p << "or_" << si << "(r, " << p << "cmpeq_epi8(id, empty)))" << (avx2 ? "" : " & 0xffff") << ';' << endl
+			<< "				" << p << "storeu_" << si << "((" << v << " *)ids, id);" << endl
+			<< "				while (m != 0)" << endl
+			<< "				{" << endl
+			<< "					k = ids[__builtin_ctz(m)];" << endl
+			<< "					in = " << p << "cmpeq_epi8(id, " << p << "set1_epi8((char)k));" << endl
+			<< "					r = " << p << "or_" << si << "(r, " << p << "and_" << si << "(in, " << classer_name << "_simd_in(lo, t + (k - " << (unsigned)SimdKernel::first_mixed << ") * " << SimdKernel::table_size << ")));" << endl
+			<< "					m &= ~(unsigned)" << p << "movemask_epi8(in);" << endl
+			<< "				}" << endl
+			<< "				" << p << "storeu_" << si << "((" << v << " *)(out + i), " << p << "and_" << si << "(r, one));" << endl
+			<< "				i += " << width << ';' << endl
+			<< "				continue;" << endl
+			<< "			}" << endl
+			<< "		}" << endl
+			<< "		for (end = n - i < " << width << " ? n : i + " << width << "; i < end; )	// the scalar code takes the rest" << endl
+			<< "		{" << endl
+			<< "			j = i;" << endl
+			<< "			b = " << classer_name << "_utf16(s, n, &i);" << endl
+			<< "			while (j < i) out[j++] = b;" << endl
+			<< "		}" << endl
+			<< "	}" << endl
+			<< '}' << endl
+			<< endl;
+	}
+	out << "#endif" << endl
+		<< endl
+		<< "#else" << endl
+		<< endl
+		<< linkage() << "void " << classer_name << "_simd(const unsigned short *s, size_t n, unsigned char *out)" << endl
+		<< '{' << endl
+		<< "	" << classer_name << "_utf16_batch(s, n, out);" << endl
+		<< '}' << endl
+		<< endl
+		<< "#endif" << endl
+		<< endl;
+}
+
+static void write_ranges(ostream &out, const range_list &ranges)
+{
 	int h = 999;
 	string d;
-	for (codevalue_vector::iterator i = codes.begin(), s = i, e = codes.end(); i != e; ++i)
+	for (range_list::const_iterator i = ranges.begin(), e = ranges.end(); i != e; ++i)
 	{
-		if (h >= 72)
-		{
-			out << d << endl << "\t\t" << *i;
-			h = 8;
-		}
-		else
+		if (h >= 64)
 		{
-			out << d << *i;
-			h += 8;
+			out << d << endl << "\t\t";
+			h = 0;
 		}
+		else out << d;
+		out << '{' << i->first << ',' << i->second << '}';
+		h += 16;
 		d = ",";
 	}
-	
-	unsigned max_codevalue = min((unsigned)0x10FFFF, (unsigned)-1 >> CHAR_BIT*(sizeof(unsigned)-sizeof(codevalue)));
-		out << endl
+}
+
+bool CGenerator::generate_dont_care(range_list *dont_care)	// the don't-care set of a test, and a cursor into it
+{
+	if (dont_care == 0 || dont_care->empty()) return false;
+	out << "	" << codevalue_type() << " dont_care[][2] = {" << hex << showbase;
+	write_ranges(out, *dont_care);
+	out << endl
 		<< "	};" << endl
-		<< endl << dec
-		<< "	" << QCODEVALUE << " c = 0;" << endl
-		<< "	unsigned failed = 0, i, j, n = sizeof(codes)/sizeof(" << QCODEVALUE << ");" << endl;
-	if (profiler) out << "	unsigned match_jumps = 0, unmatched_jumps = 0, ascii_jumps = 0, max_jumps = 0;" << endl;
-	out	<< "	printf(\"\\nTesting " << classer_name << " (matching " << codes.size() << "):\\n\");" << endl
+		<< "	unsigned q = 0, m = sizeof(dont_care)/sizeof(dont_care[0]);" << endl;
+	return true;
+}
+
+void CGenerator::generate_test(string classer_name, range_list &ranges, range_list *dont_care, bool profiler, bool utf16, bool simd)
+{
+	out << "#include <stdio.h>" << endl
+		<< "#include \"uniclasser.h\"" << endl << endl << showbase << boolalpha
+		<< "#define AVG(s,n) (n==0? 0 : ((float)(s)/(n)))" << endl << endl 
+		<< "void test_" << classer_name << "()" << endl
+		<< '{' << endl
+		<< "	" << codevalue_type() << " ranges[][2] = {" << hex;
+	write_ranges(out, ranges);	// the tested set is given as its ranges, so that the test stays small even for huge sets
+	out << endl
+		<< "	};" << endl;
+	
+	// codevalues of the don't-care set may match or not, so they are not tested
+	bool skip = generate_dont_care(dont_care);
+	
+	unsigned max_codevalue = min((unsigned)MatchTree::last_codevalue(width), (unsigned)-1 >> CHAR_BIT*(sizeof(unsigned)-sizeof(codevalue)));
+	out	<< endl << dec
+		<< "	" << codevalue_type() << " c = 0;" << endl
+		<< "	unsigned failed = 0, i, j, n = sizeof(ranges)/sizeof(ranges[0]);" << endl;
+	if (profiler) out << "	unsigned matched = " << range_count(ranges) << ", match_jumps = 0, unmatched_jumps = 0, ascii_jumps = 0, max_jumps = 0;" << endl;
+	out	<< "	printf(\"\\nTesting " << classer_name << " (matching " << range_count(ranges) << "):\\n\");" << endl
 		<< "	for (i = 0, j = 0; i <= " << hex << max_codevalue << "; ++i, ++c)" << endl 
 		<< "	{" << endl 
 		<< "#ifdef TEST_ONLY_MATCHES" << endl
-		<< "		if (j < n) c = codes[j]; else break;" << endl
+		<< "		if (j >= n) break; else if (c < ranges[j][0]) c = ranges[j][0];" << endl
 		<< "#endif" << endl
-		<< "		int b = j < n && c == codes[j];" << endl 
-		<< "		if (b) ++j;" << endl;
+		<< "		int b = j < n && c >= ranges[j][0];" << endl 
+		<< "		if (b && c == ranges[j][1]) ++j;" << endl;
+	if (skip)
+		out	<< "		while (q < m && dont_care[q][1] < c) ++q;" << endl
+			<< "		if (q < m && c >= dont_care[q][0]) continue;" << endl;
 	out	<< "		if (" << classer_name << "(c) != b)" << endl 
 		<< "		{" << endl 
 		<< "			printf(\"Failed test: U+%04x should %smatch\\n\", c, b?\"\":\"not \");" << endl
@@ -192,15 +513,303 @@ void CGenerator::generate_test(string classer_name, codevalue_vector &codes, boo
 		out << "		if (b) match_jumps += jumps(); else unmatched_jumps += jumps();" << endl
 			<< "		if (c < 128) ascii_jumps += jumps();" << endl
 			<< "		if (jumps() > max_jumps) max_jumps = jumps();" << endl;
-	out	<< "	}" << endl
-		<< "	if (failed == 0) printf(\"All %d tests passed!\\n\", i);" << endl 
+	if (utf16)
+		out	<< "		{" << endl
+			<< "			unsigned short u[2] = { (unsigned short)(c < 0x10000 ? c : 0xd800 + ((c - 0x10000) >> 10)), (unsigned short)(0xdc00 + ((c - 0x10000) & 0x3ff)) };" << endl
+			<< "			size_t k = 0, len = c < 0x10000 ? 1 : 2;" << endl
+			<< "			unsigned char units[2];" << endl
+			<< "			" << classer_name << "_utf16_batch(u, len, units);" << endl
+			<< "			if (" << classer_name << "_utf16(u, len, &k) != b || k != len || units[0] != b || units[len-1] != b)" << endl
+			<< "			{" << endl
+			<< "				printf(\"Failed UTF-16 test: U+%04x should %smatch\\n\", c, b?\"\":\"not \");" << endl
+			<< "				++failed;" << endl
+			<< "			}" << endl
+			<< "		}" << endl;
+	out	<< "	}" << endl;
+	if (simd)
+		out	<< "	{" << endl
+			<< "		// the vectorized kernel must agree with the scalar batch entry point on all the code units" << endl
+			<< "		static unsigned short units[0x10000];" << endl
+			<< "		static unsigned char expected[0x10000], actual[0x10000];" << endl
+			<< "		for (j = 0; j < 0x10000; ++j) units[j] = (unsigned short)j;" << endl
+			<< "		" << classer_name << "_utf16_batch(units, 0x10000, expected);" << endl
+			<< "		" << classer_name << "_simd(units, 0x10000, actual);" << endl
+			<< "		for (j = 0; j < 0x10000; ++j) if (actual[j] != expected[j])" << endl
+			<< "		{" << endl
+			<< "			printf(\"Failed SIMD test: U+%04x should %smatch\\n\", j, expected[j]?\"\":\"not \");" << endl
+			<< "			++failed;" << endl
+			<< "		}" << endl
+			<< "	}" << endl;
+	out	<< "	if (failed == 0) printf(\"All %d tests passed!\\n\", i);" << endl 
 		<< "	else printf(\"Failed %d out of %d tests!\\n\", failed, i);" << endl;
 	if (profiler)
-		out << "	printf(\"Jumps per codevalue: total=%.1f, matched=%.1f, unmatched=%.1f, ascii=%.1f, max=%d\\n\", AVG(match_jumps+unmatched_jumps,i), AVG(match_jumps,n), AVG(unmatched_jumps,i-n), AVG(ascii_jumps,128), max_jumps);" << endl;
+		out << "	printf(\"Jumps per codevalue: total=%.1f, matched=%.1f, unmatched=%.1f, ascii=%.1f, max=%d\\n\", AVG(match_jumps+unmatched_jumps,i), AVG(match_jumps,matched), AVG(unmatched_jumps,i-matched), AVG(ascii_jumps,128), max_jumps);" << endl;
 	out	<< '}' << endl
 		<< endl;
 }
 
+string CGenerator::generate_declarations(string classer_name, bool utf16, bool simd)
+{
+	ostringstream d;
+	d << "int " << classer_name << '(' << codevalue_type() << " c);" << endl;
+	if (utf16)
+		d << "int " << classer_name << "_utf16(const unsigned short *s, size_t n, size_t *i);" << endl
+		  << "void " << classer_name << "_utf16_batch(const unsigned short *s, size_t n, unsigned char *out);" << endl;
+	if (utf16 && simd)
+		d << "void " << classer_name << "_simd(const unsigned short *s, size_t n, unsigned char *out);" << endl;
+	return d.str();
+}
+
+#pragma GCC diagnostic ignored "-Wwrite-strings"  // remove "Deprecated conversion from string constant to 'char*'"
+
+string CGenerator::generate_classes()	// the bit of every classifier in a bitmask of classes
+{
+	ostringstream d;
+	d << hex << showbase;
+	for (unsigned i = 0, n = classers.size(); i < n; ++i)
+		d << "#define " << classers[i] << "_class " << (1u << i) << 'u' << endl;
+	return d.str();
+}
+
+void CGenerator::generate_class_lookup(ClassTable &table, string name)	// the tables of table, and name_id(c) that looks up a class id in them
+{
+	write_table(out, blob, "unsigned short", name + "_stage1", table.stage1, true);
+	if (table.masks.size() <= 0x100) write_table(out, blob, "unsigned char", name + "_stage2", table.stage2, true);
+	else write_table(out, blob, "unsigned short", name + "_stage2", table.stage2, true);
+	write_table(out, blob, "unsigned", name + "_masks", table.masks, true);
+	
+	unsigned block_size = 1 << ClassTable::block_bits;
+	out << dec
+		<< "static unsigned " << name << "_id(" << codevalue_type() << " c)" << endl
+		<< '{' << endl
+		<< "	unsigned u = (unsigned)c;" << endl
+		<< "	if (u >= " << hex << showbase << ClassTable::codevalues << ") return 0;" << endl
+		<< "	return " << name << "_stage2[(" << name << "_stage1[u >> " << dec << ClassTable::block_bits << "] << " << ClassTable::block_bits << ") | (u & " << hex << block_size - 1 << ")];" << endl
+		<< '}' << endl
+		<< endl;
+}
+
+void CGenerator::generate_segmenter(ClassTable &table, bool test, range_list *dont_care)
+{
+	// Every codevalue is classified once against all classifiers, by looking
+	// up its class id in a two-stage table. Runs are compared by class id, and
+	// the id is turned into its bitmask of classifiers only at run boundaries.
+	ostringstream d;
+	d << generate_classes()
+	  << endl
+	  << "typedef void (*uniclasser_segment_callback)(size_t start, size_t length, unsigned classes, void *context);" << endl
+	  << endl
+	  << "unsigned uniclasser_segment_classes(" << codevalue_type() << " c);" << endl
+	  << "void uniclasser_segment(const " << codevalue_type() << " *buf, size_t len, uniclasser_segment_callback callback, void *context);" << endl;
+	declarations.push_back(d.str());
+	
+	out_open("uniclasser_segment.c", "segmenter");
+	out << "#include \"uniclasser.h\"" << endl << endl;
+	generate_class_lookup(table, "uniclasser_segment");
+	out << "unsigned uniclasser_segment_classes(" << codevalue_type() << " c)" << endl
+		<< '{' << endl
+		<< "	return uniclasser_segment_masks[uniclasser_segment_id(c)];" << endl
+		<< '}' << endl
+		<< endl
+		<< "void uniclasser_segment(const " << codevalue_type() << " *buf, size_t len, uniclasser_segment_callback callback, void *context)" << endl
+		<< '{' << endl
+		<< "	size_t start = 0, i;" << endl
+		<< "	unsigned run, id;" << endl
+		<< "	if (len == 0) return;" << endl
+		<< "	run = uniclasser_segment_id(buf[0]);" << endl
+		<< "	for (i = 1; i < len; ++i)" << endl
+		<< "	{" << endl
+		<< "		id = uniclasser_segment_id(buf[i]);" << endl
+		<< "		if (id == run) continue;" << endl
+		<< "		callback(start, i - start, uniclasser_segment_masks[run], context);" << endl
+		<< "		start = i;" << endl
+		<< "		run = id;" << endl
+		<< "	}" << endl
+		<< "	callback(start, len - start, uniclasser_segment_masks[run], context);" << endl
+		<< '}' << endl;
+	out_close();
+	
+	if (test)
+	{
+		out_open("test_uniclasser_segment.c", "segmenter test");
+		generate_segmenter_test(dont_care);
+		out_close();
+		segmenter_test = true;
+	}
+	segmenter = true;
+}
+
+void CGenerator::generate_segmenter_test(range_list *dont_care)
+{
+	unsigned max_codevalue = min((unsigned)MatchTree::last_codevalue(width), (unsigned)-1 >> CHAR_BIT*(sizeof(unsigned)-sizeof(codevalue)));
+	out << "#include <stdio.h>" << endl
+		<< "#include \"uniclasser.h\"" << endl
+		<< endl
+		<< "struct segment_check" << endl
+		<< '{' << endl
+		<< "	const " << codevalue_type() << " *buf;" << endl
+		<< "	size_t next;" << endl
+		<< "	unsigned last, failed;" << endl
+		<< "};" << endl
+		<< endl
+		<< "static void check_segment(size_t start, size_t length, unsigned classes, void *context)" << endl
+		<< '{' << endl
+		<< "	struct segment_check *s = (struct segment_check *)context;" << endl
+		<< "	size_t i;" << endl
+		<< "	if (start != s->next || length == 0 || (start > 0 && classes == s->last)) ++s->failed;" << endl
+		<< "	for (i = start; i < start + length; ++i)" << endl
+		<< "		if (uniclasser_segment_classes(s->buf[i]) != classes) ++s->failed;" << endl
+		<< "	s->next = start + length;" << endl
+		<< "	s->last = classes;" << endl
+		<< '}' << endl
+		<< endl
+		<< "void test_uniclasser_segment()" << endl
+		<< '{' << endl
+		<< "	unsigned failed = 0, i, n = " << hex << showbase << max_codevalue + 1 << ", classes;" << endl
+		<< "	" << codevalue_type() << " c, *buf = (" << codevalue_type() << " *)malloc(n * sizeof(" << codevalue_type() << "));" << endl
+		<< "	struct segment_check s = { 0, 0, 0, 0 };" << endl;
+	
+	// codevalues of the don't-care set may be in any classes, so they are only segmented
+	bool skip = generate_dont_care(dont_care);
+	out	<< "	printf(\"\\nTesting uniclasser_segment:\\n\");" << endl
+		<< "	for (i = 0; i < n; ++i)" << endl
+		<< "	{" << endl
+		<< "		c = (" << codevalue_type() << ")i;" << endl
+		<< "		buf[i] = c;" << endl;
+	if (skip)
+		out	<< "		while (q < m && dont_care[q][1] < c) ++q;" << endl
+			<< "		if (q < m && c >= dont_care[q][0]) continue;" << endl;
+	out	<< "		classes = 0;" << endl;
+	for (vector<string>::const_iterator i = classers.begin(), e = classers.end(); i != e; ++i)
+		out << "		if (" << *i << "(c)) classes |= " << *i << "_class;" << endl;
+	out	<< "		if (uniclasser_segment_classes(c) != classes)" << endl
+		<< "		{" << endl
+		<< "			printf(\"Failed test: U+%04x should be in classes %x\\n\", i, classes);" << endl
+		<< "			++failed;" << endl
+		<< "		}" << endl
+		<< "	}" << endl
+		<< "	s.buf = buf;" << endl
+		<< "	uniclasser_segment(buf, n, check_segment, &s);" << endl
+		<< "	if (s.next != n || s.failed != 0)" << endl
+		<< "	{" << endl
+		<< "		printf(\"Failed test: runs do not cover the buffer exactly\\n\");" << endl
+		<< "		++failed;" << endl
+		<< "	}" << endl
+		<< "	free(buf);" << endl
+		<< "	if (failed == 0) printf(\"All %d tests passed!\\n\", i);" << endl
+		<< "	else printf(\"Failed %d out of %d tests!\\n\", failed, i);" << endl
+		<< '}' << endl
+		<< endl;
+}
+
+void CGenerator::generate_mask(ClassTable &table, bool test, range_list *dont_care)
+{
+	// All the classifiers are answered by a single walk: a balanced tree of
+	// compares on the boundaries of the runs of equal bitmasks, when there are
+	// few of them, or else a lookup in the two-stage table of class ids, which
+	// is the segmenter's own if there is one.
+	ostringstream d;
+	if (!segmenter) d << generate_classes() << endl;
+	d << "unsigned uniclasser_mask(" << codevalue_type() << " c);	/* the bitmask of the classes of all classifiers that match c */" << endl;
+	declarations.push_back(d.str());
+	
+	out_open("uniclasser_mask.c", "fused classifier");
+	out << "#include \"uniclasser.h\"" << endl << endl;
+	if (table.run_starts.size() <= ClassTable::max_runs)
+	{
+		out << "unsigned uniclasser_mask(" << codevalue_type() << " c)" << endl
+			<< '{' << endl
+			<< "	unsigned u = (unsigned)c;" << endl;
+		generate_mask_tree(table, 0, table.run_starts.size(), 1);
+		out << '}' << endl;
+	}
+	else if (segmenter)
+		out << "unsigned uniclasser_mask(" << codevalue_type() << " c)" << endl
+			<< '{' << endl
+			<< "	return uniclasser_segment_classes(c);" << endl
+			<< '}' << endl;
+	else
+	{
+		generate_class_lookup(table, "uniclasser_mask");
+		out << "unsigned uniclasser_mask(" << codevalue_type() << " c)" << endl
+			<< '{' << endl
+			<< "	return uniclasser_mask_masks[uniclasser_mask_id(c)];" << endl
+			<< '}' << endl;
+	}
+	out_close();
+	
+	if (test)
+	{
+		out_open("test_uniclasser_mask.c", "fused classifier test");
+		generate_mask_test(dont_care);
+		out_close();
+		mask_test = true;
+	}
+}
+
+void CGenerator::generate_mask_tree(ClassTable &table, size_t first, size_t last, unsigned depth)	// of the runs from first up to last
+{
+	string indent(depth, '\t');
+	if (last - first == 1)
+	{
+		out << indent << "return " << hex << showbase << table.run_masks[first] << "u;" << endl;
+		return;
+	}
+	
+	size_t middle = (first + last) / 2;
+	out << indent << "if (u < " << hex << showbase << table.run_starts[middle] << ')' << endl;
+	if (middle - first == 1) generate_mask_tree(table, first, middle, depth + 1);
+	else
+	{
+		out << indent << '{' << endl;
+		generate_mask_tree(table, first, middle, depth + 1);
+		out << indent << '}' << endl;
+	}
+	generate_mask_tree(table, middle, last, depth);
+}
+
+void CGenerator::generate_mask_test(range_list *dont_care)
+{
+	// every bit of the mask must agree with its own classifier on every codevalue of the width,
+	// which for wider classifiers is taken up to 21 bits, so that codevalues beyond unicode are tested as well
+	unsigned max_codevalue = min(((unsigned)1 << min(width, 21u)) - 1, (unsigned)-1 >> CHAR_BIT*(sizeof(unsigned)-sizeof(codevalue)));
+	unsigned all = classers.size() < 32 ? (1u << classers.size()) - 1 : ~0u;
+	out << "#include <stdio.h>" << endl
+		<< "#include \"uniclasser.h\"" << endl
+		<< endl
+		<< "void test_uniclasser_mask()" << endl
+		<< '{' << endl
+		<< "	unsigned failed = 0, i, mask;" << endl
+		<< "	" << codevalue_type() << " c;" << endl;
+	
+	// codevalues of the don't-care set may be in any classes, so they are not tested
+	bool skip = generate_dont_care(dont_care);
+	out	<< "	printf(\"\\nTesting uniclasser_mask:\\n\");" << endl
+		<< "	for (i = 0; i <= " << hex << showbase << max_codevalue << "; ++i)" << endl
+		<< "	{" << endl
+		<< "		c = (" << codevalue_type() << ")i;" << endl;
+	if (skip)
+		out	<< "		while (q < m && dont_care[q][1] < c) ++q;" << endl
+			<< "		if (q < m && c >= dont_care[q][0]) continue;" << endl;
+	out	<< "		mask = uniclasser_mask(c);" << endl
+		<< "		if ((mask & ~" << all << "u) != 0)" << endl
+		<< "		{" << endl
+		<< "			printf(\"Failed test: U+%04x has classes %x of no classifier\\n\", i, mask);" << endl
+		<< "			++failed;" << endl
+		<< "		}" << endl;
+	for (vector<string>::const_iterator i = classers.begin(), e = classers.end(); i != e; ++i)
+		out << "		if (((mask & " << *i << "_class) != 0) != (" << *i << "(c) != 0))" << endl
+			<< "		{" << endl
+			<< "			printf(\"Failed test: U+%04x should %sbe in " << *i << "_class\\n\", i, " << *i << "(c) ? \"\" : \"not \");" << endl
+			<< "			++failed;" << endl
+			<< "		}" << endl;
+	out	<< "	}" << endl
+		<< "	if (failed == 0) printf(\"All %d tests passed!\\n\", i);" << endl
+		<< "	else printf(\"Failed %d out of %d tests!\\n\", failed, i);" << endl
+		<< '}' << endl
+		<< endl;
+}
+
 void CGenerator::generate_header(bool profiler)
 {
 	out << "#ifndef UNICLASSER_H" << endl 
@@ -209,8 +818,13 @@ void CGenerator::generate_header(bool profiler)
 		<< "#include <stdlib.h>" << endl 
 		<< endl;
 	
-	for (vector<string>::const_iterator i = classers.begin(), e = classers.end(); i != e; ++i)
-		out << "int " << *i << '(' << QCODEVALUE << " c);" << endl;
+	if (blob != 0)
+		out << "extern const unsigned char *uniclasser_tables;	// the mapped table blob" << endl
+			<< "int uniclasser_load_tables(const char *path);	// 1 on success, 0 if path cannot be mapped or does not match this code" << endl
+			<< endl;
+	
+	for (vector<string>::const_iterator i = declarations.begin(), e = declarations.end(); i != e; ++i)
+		out << *i;
 	out << endl;
 	
 	if (profiler) 
@@ -237,12 +851,16 @@ void CGenerator::generate_test_header()
 	
 	for (vector<string>::const_iterator i = classers.begin(), e = classers.end(); i != e; ++i)
 		out << "void test_" << *i << "();" << endl;
+	if (segmenter_test) out << "void test_uniclasser_segment();" << endl;
+	if (mask_test) out << "void test_uniclasser_mask();" << endl;
 	out << endl;
 	
 	out << "void test()" << endl 
 		<< '{' << endl;
 	for (vector<string>::const_iterator i = classers.begin(), e = classers.end(); i != e; ++i)
 		out << "	test_" << *i << "();" << endl;
+	if (segmenter_test) out << "	test_uniclasser_segment();" << endl;
+	if (mask_test) out << "	test_uniclasser_mask();" << endl;
 	out << '}' << endl << endl;
 	
 	out << "#endif";
@@ -260,39 +878,118 @@ void CGenerator::generate_profiler()
 	<< "int jumps() { return j; }" << endl;
 }
 
-#pragma GCC diagnostic ignored "-Wwrite-strings"  // remove "Deprecated conversion from string constant to 'char*'"
+void CGenerator::generate_tables_loader()
+{
+	unsigned words = TableBlob::header_words + 2 * blob->tables.size();
+	out << "#include <fcntl.h>" << endl
+		<< "#include <unistd.h>" << endl
+		<< "#include <sys/mman.h>" << endl
+		<< "#include <sys/stat.h>" << endl
+		<< "#include \"uniclasser.h\"" << endl
+		<< endl
+		<< "const unsigned char *uniclasser_tables = 0;" << endl
+		<< endl
+		<< "int uniclasser_load_tables(const char *path)" << endl
+		<< '{' << endl
+		<< "	// the blob is mapped shared and read-only, so all the processes that load it share its pages" << endl
+		<< "	int fd = open(path, O_RDONLY);" << endl
+		<< "	struct stat st;" << endl
+		<< "	void *p;" << endl
+		<< "	const unsigned *h;" << endl
+		<< "	unsigned i;" << endl
+		<< "	int valid;" << endl
+		<< "	if (fd < 0) return 0;" << endl
+		<< "	p = fstat(fd, &st) == 0 && st.st_size >= " << dec << words * 4 << " ? mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;" << endl
+		<< "	close(fd);" << endl
+		<< "	if (p == MAP_FAILED) return 0;" << endl
+		<< endl
+		<< "	h = (const unsigned *)p;" << endl
+		<< "	valid = h[0] == " << hex << showbase << TableBlob::magic << "u && h[1] == " << dec << TableBlob::version << " && h[2] == " << hex << blob->key() << "u && h[3] == " << dec << blob->tables.size() << " && h[4] == (unsigned)st.st_size;" << endl
+		<< "	for (i = 0; valid && i < " << blob->tables.size() << "u; ++i) valid = h[" << TableBlob::header_words << " + 2*i] <= h[4] && h[" << TableBlob::header_words + 1 << " + 2*i] <= h[4] - h[" << TableBlob::header_words << " + 2*i];" << endl
+		<< "	if (!valid)" << endl
+		<< "	{" << endl
+		<< "		munmap(p, st.st_size);" << endl
+		<< "		return 0;" << endl
+		<< "	}" << endl
+		<< endl
+		<< "	// a blob loaded before stays mapped, since the classifiers may still be reading it on other threads" << endl
+		<< "	uniclasser_tables = (const unsigned char *)p;" << endl
+		<< "	return 1;" << endl
+		<< '}' << endl;
+}
 
 void CGenerator::out_open(string filename, char * const what)
 {
-	if (what != 0) cout << "Writing " << what << " to " << output_dir << filename << endl;
-	out.open((output_dir + filename).c_str(), ios_base::out);
+	out_filename = filename;
+	out_what = what;
+	out.str("");
 	
 	out << "// Autogenerated by the uniclasser generator. See " << URL << endl 
 		<< "// Permission is hereby granted to include, modify, republish and resell this code for any purpose." << endl << endl;
 }
 
+void CGenerator::out_with_tables(const string &code)	// appends code, preceded by the tables it uses
+{
+	out.seekp(0, ios_base::end);
+	out << tables.str() << code;
+	tables.str("");
+}
+
 void CGenerator::out_close()
 {
-	out.close();
+	generated.push_back(make_pair(out_filename, out.str()));
+	out_write(out_filename, out.str(), out_what);
+}
+
+void CGenerator::out_write(string filename, const string &content, const char * const what)
+{
+	// files are compared with their previous content before writing, so
+	// regenerating an unchanged classifier does not trigger any rebuilds
+	bool written = write_if_changed(output_dir + filename, content);
+	if (what == 0) return;
+	if (written) cout << "Writing " << what << " to " << output_dir << filename << endl;
+	else cout << output_dir << filename << " is unchanged (" << what << ")" << endl;
 }
 
-void CGenerator::generate(string classer_name, Predicate &p, codevalue_vector *test_codes, bool profiler)
+void CGenerator::generate(string classer_name, Predicate &p, range_list *test_ranges, bool profiler, Predicate *bmp_predicate, SimdKernel *simd, range_list *dont_care)
 {
 	classers.push_back(classer_name);
 	c_profile = profiler;
+	generated.clear();
+	table_prefix = classer_name;
+	table_count = 0;
 	
-	out_open(classer_name + ".c", "classifier");
+	// a header-only classifier is declared by including its definitions
+	if (header_only) declarations.push_back("#include \"" + classer_name + ".h\"\n");
+	else declarations.push_back(generate_declarations(classer_name, bmp_predicate != 0, simd != 0));
+	generated.push_back(make_pair(DECLARATIONS, declarations.back()));
+	
+	out_open(classer_name + (header_only ? ".h" : ".c"), "classifier");
 	generate_classer(classer_name, p, profiler);
+	if (bmp_predicate != 0) generate_utf16(classer_name, *bmp_predicate);
+	if (bmp_predicate != 0 && simd != 0) generate_simd(classer_name, *simd);
+	if (header_only) out << "#endif" << endl;
 	out_close();
 	
-	if (test_codes != 0)
+	if (test_ranges != 0)
 	{
 		out_open("test_" + classer_name + ".c", "classifier test");
-		generate_test(classer_name, *test_codes, profiler);
+		generate_test(classer_name, *test_ranges, dont_care, profiler, bmp_predicate != 0, simd != 0);
 		out_close();
 	}
 }
 
+void CGenerator::restore(string classer_name, generated_files &files)
+{
+	classers.push_back(classer_name);
+	
+	for (generated_files::const_iterator i = files.begin(), e = files.end(); i != e; ++i)
+	{
+		if (i->first == DECLARATIONS) declarations.push_back(i->second);
+		else out_write(i->first, i->second, "cached file");
+	}
+}
+
 void CGenerator::finalize(bool test, bool profiler)
 {
 	out_open("uniclasser.h", "a combined header file");
@@ -313,6 +1010,14 @@ void CGenerator::finalize(bool test, bool profiler)
 		out_close();
 	}
 	
+	if (blob != 0)
+	{
+		out_write(blob->filename, blob->content(), "a table blob");
+		out_open("uniclasser_tables.c", "table blob loader");
+		generate_tables_loader();
+		out_close();
+	}
+	
 	out_open("main.c", "main");
 	generate_main(test, profiler);
 	out_close();
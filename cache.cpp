@@ -0,0 +1,116 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <errno.h>
+#include <sys/stat.h>
+#include "cache.hpp"
+
+using namespace std;
+
+
+//----- Hash ------------------------------------------------------------------
+
+Hash& Hash::add(const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char *)data, *e = p + size;
+	while (p != e)
+	{
+		h ^= *p++;
+		h *= 1099511628211ULL;
+	}
+	return *this;
+}
+
+bool Hash::add_file(string filename)
+{
+	ifstream in(filename.c_str(), ios_base::in | ios_base::binary);
+	if (!in) return false;
+
+	char buf[65536];
+	while (in.read(buf, sizeof(buf)) || in.gcount() > 0) add(buf, in.gcount());
+	return true;
+}
+
+string Hash::hex() const
+{
+	ostringstream s;
+	s << std::hex << setw(16) << setfill('0') << h;
+	return s.str();
+}
+
+
+//----- File output -----------------------------------------------------------
+
+bool read_file(string filename, string &content)
+{
+	ifstream in(filename.c_str(), ios_base::in | ios_base::binary);
+	if (!in) return false;
+
+	ostringstream s;
+	s << in.rdbuf();
+	content = s.str();
+	return true;
+}
+
+bool write_if_changed(string filename, const string &content)
+{
+	string existing;
+	if (read_file(filename, existing) && existing == content) return false;
+
+	ofstream out(filename.c_str(), ios_base::out | ios_base::binary);
+	out << content;
+	return true;
+}
+
+
+//----- ClassifierCache -------------------------------------------------------
+
+#define CACHE_MAGIC "uniclasser-cache 1"
+
+// An entry is a text header line followed by each file as a name line, a size
+// line and the raw content.
+
+bool ClassifierCache::load(string key, generated_files &files)
+{
+	string entry;
+	if (!read_file(dir + key, entry)) return false;
+
+	istringstream in(entry);
+	string magic;
+	unsigned n;
+	if (!getline(in, magic) || magic != CACHE_MAGIC || !(in >> n)) return false;
+
+	files.clear();
+	while (n-- > 0)
+	{
+		string name;
+		size_t size;
+		in.ignore(1, '\n');
+		if (!getline(in, name) || !(in >> size) || in.get() != '\n') return false;
+
+		string content(size, '\0');
+		if (size > 0 && !in.read(&content[0], size)) return false;
+		files.push_back(make_pair(name, content));
+	}
+	return true;
+}
+
+void ClassifierCache::store(string key, generated_files &files)
+{
+	if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+	{
+		cerr << "Error: Could not create cache directory " << dir << ". Classifier not cached." << endl;
+		return;
+	}
+
+	ostringstream entry;
+	entry << CACHE_MAGIC << endl << files.size();
+	for (generated_files::const_iterator i = files.begin(), e = files.end(); i != e; ++i)
+		entry << endl << i->first << endl << i->second.size() << endl << i->second;
+	write_if_changed(dir + key, entry.str());
+}
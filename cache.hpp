@@ -0,0 +1,54 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <string>
+#include <stdint.h>
+#include "generator.hpp"
+
+
+//----- Hash ------------------------------------------------------------------
+
+// 64 bit FNV-1a. Not cryptographic, but more than enough to tell apart the
+// inputs of two classifiers.
+struct Hash
+{
+	Hash() : h(14695981039346656037ULL) {}
+
+	Hash& add(const void *data, size_t size);
+	Hash& add(const std::string &s) { return add(s.c_str(), s.size() + 1); } // include the terminating null as a separator
+	bool add_file(std::string filename);
+
+	std::string hex() const;
+
+	uint64_t h;
+};
+
+
+//----- File output -----------------------------------------------------------
+
+// writes content to filename, unless the file already holds exactly this content.
+// Leaving the file untouched keeps its timestamp, so nothing downstream is rebuilt.
+// Returns true if the file was written.
+bool write_if_changed(std::string filename, const std::string &content);
+
+
+//----- ClassifierCache -------------------------------------------------------
+
+// Content addressed store of generated classifiers. Each entry holds the files
+// that a generator produced for a single classifier, and is keyed by a hash of
+// everything that went into producing them (see main.cpp).
+struct ClassifierCache
+{
+	ClassifierCache(std::string dir) : dir(dir) {}
+
+	bool load(std::string key, generated_files &files);
+	void store(std::string key, generated_files &files);
+
+	std::string dir;
+};
+
+#endif
@@ -0,0 +1,115 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include <map>
+#include <algorithm>
+#include "class_table.hpp"
+
+using namespace std;
+
+
+//----- ClassTable ------------------------------------------------------------
+
+void ClassTable::add(const range_list &ranges)
+{
+	uint32_t bit = (uint32_t)1 << classes++;
+	for (range_list::const_iterator i = ranges.begin(), e = ranges.end(); i != e; ++i)
+	{
+		if ((uint32_t)i->first >= codevalues) break;
+		bounds.push_back(make_pair((uint32_t)i->first, bit));
+		bounds.push_back(make_pair((uint32_t)i->second < codevalues ? (uint32_t)i->second + 1 : (uint32_t)codevalues, bit));
+	}
+}
+
+void ClassTable::build()
+{
+	// the ranges of a classifier never overlap, so toggling its bit at their
+	// bounds gives the bitmask of every run
+	sort(bounds.begin(), bounds.end());
+	run_starts.assign(1, 0);
+	run_masks.assign(1, 0);
+	uint32_t mask = 0;
+	for (size_t i = 0, n = bounds.size(); i < n; )
+	{
+		uint32_t c = bounds[i].first;
+		for (; i < n && bounds[i].first == c; ++i) mask ^= bounds[i].second;
+		if (c >= codevalues || mask == run_masks.back()) continue;
+		if (c == 0) run_masks.back() = mask;
+		else
+		{
+			run_starts.push_back(c);
+			run_masks.push_back(mask);
+		}
+	}
+	if (run_masks.back() != 0)
+	{
+		run_starts.push_back((uint32_t)codevalues);
+		run_masks.push_back(0);
+	}
+	vector<pair<uint32_t, uint32_t> >().swap(bounds);
+
+	// give every distinct bitmask an id in the order of the runs, making sure
+	// that matching nothing gets 0
+	map<uint32_t, uint16_t> ids;
+	masks.assign(1, 0);
+	ids[0] = 0;
+	vector<uint16_t> run_ids;
+	for (size_t r = 0, n = run_masks.size(); r < n; ++r)
+	{
+		map<uint32_t, uint16_t>::iterator id = ids.find(run_masks[r]);
+		if (id == ids.end())
+		{
+			id = ids.insert(make_pair(run_masks[r], (uint16_t)masks.size())).first;
+			masks.push_back(run_masks[r]);
+		}
+		run_ids.push_back(id->second);
+	}
+
+	// and store every distinct block only once, where a block that lies
+	// within a single run is found by its id alone
+	map<vector<uint16_t>, uint16_t> blocks;
+	map<uint16_t, uint16_t> uniform;
+	const uint32_t block_size = 1 << block_bits;
+	vector<uint16_t> block(block_size);
+	stage1.clear();
+	stage2.clear();
+
+	size_t r = 0, n = run_starts.size();
+	for (uint32_t b = 0; b < codevalues; b += block_size)
+	{
+		while (r + 1 < n && run_starts[r + 1] <= b) ++r;
+		if (r + 1 == n || run_starts[r + 1] >= b + block_size)
+		{
+			map<uint16_t, uint16_t>::iterator i = uniform.find(run_ids[r]);
+			if (i == uniform.end())
+			{
+				i = uniform.insert(make_pair(run_ids[r], (uint16_t)(stage2.size() >> block_bits))).first;
+				stage2.insert(stage2.end(), block_size, run_ids[r]);
+			}
+			stage1.push_back(i->second);
+			continue;
+		}
+
+		for (size_t k = r; k < n && run_starts[k] < b + block_size; ++k)
+		{
+			uint32_t first = max(run_starts[k], b), last = k + 1 < n ? min(run_starts[k + 1], b + block_size) : b + block_size;
+			fill(block.begin() + (first - b), block.begin() + (last - b), run_ids[k]);
+		}
+
+		map<vector<uint16_t>, uint16_t>::iterator i = blocks.find(block);
+		if (i == blocks.end())
+		{
+			i = blocks.insert(make_pair(block, (uint16_t)(stage2.size() >> block_bits))).first;
+			stage2.insert(stage2.end(), block.begin(), block.end());
+		}
+		stage1.push_back(i->second);
+	}
+}
+
+uint32_t ClassTable::lookup(codevalue c) const
+{
+	uint32_t u = (uint32_t)c;
+	if (u >= codevalues) return 0;
+	return masks[stage2[(stage1[u >> block_bits] << block_bits) | (u & ((1 << block_bits) - 1))]];
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef CLASS_TABLE_H
+#define CLASS_TABLE_H
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <ostream>
+#include <stdint.h>
+#include "codevalue.hpp"
+#include "range_list.hpp"
+
+
+//----- ClassTable ------------------------------------------------------------
+
+// Maps every codevalue to the set of classifiers that match it, as a bitmask
+// with one bit per classifier (in the order they were added). Since there are
+// only a handful of distinct bitmasks, each gets a small class id, and the
+// ids are stored in a two-stage table: stage1 maps the top bits of a
+// codevalue to one of the distinct blocks of ids in stage2, which is indexed
+// by the low bits.
+//
+// The codevalues also fall into runs of equal bitmasks, and when there are at
+// most max_runs of them, a tree of compares on their boundaries is smaller
+// and faster than the tables. The runs are found from the boundaries of the
+// ranges alone, and the tables are filled from the runs a block at a time,
+// so no codevalue is ever visited on its own.
+struct ClassTable
+{
+	ClassTable() : classes(0) {}
+
+	void add(const range_list &ranges);
+	void build();
+
+	uint32_t lookup(codevalue c) const;
+
+	unsigned classes;				// number of classifiers added
+	std::vector<uint32_t> masks;	// bitmask of every class id
+	std::vector<uint16_t> stage1;	// block of every 256 codevalues
+	std::vector<uint16_t> stage2;	// class id of every codevalue in every distinct block
+	std::vector<std::pair<uint32_t, uint32_t> > bounds;	// codevalues where a classifier's bit toggles, until build()
+	std::vector<uint32_t> run_starts;	// first codevalue of every run, the last one matching nothing up to the end
+	std::vector<uint32_t> run_masks;	// bitmask of every run
+
+	static const unsigned max_classes = 32, block_bits = 8, max_runs = 64;
+	static const uint32_t codevalues = 0x110000;
+};
+
+
+//----- Table output ----------------------------------------------------------
+
+// writes values as the initializer of a static C array
+template <class T>
+void write_array(std::ostream &out, std::string type, std::string name, const std::vector<T> &values)
+{
+	out << "static const " << type << ' ' << name << '[' << std::dec << values.size() << "] = {" << std::hex << std::noshowbase;
+	for (size_t i = 0, n = values.size(); i < n; ++i)
+		out << (i == 0 ? "" : ",") << (i % 16 == 0 ? "\n\t" : "") << "0x" << (uint32_t)values[i];
+	out << std::endl << "};" << std::endl << std::endl;
+}
+
+#endif
@@ -6,34 +6,79 @@
 #define CPP_GENERATOR_H
 
 #include <string>
-#include <fstream>
+#include <sstream>
+#include <stdint.h>
 #include "generator.hpp"
 
+struct TableBlob;
+
 struct CppGenerator : public IGenerator
 {
-	CppGenerator(std::string output_dir) : output_dir(output_dir) {}
+	CppGenerator(std::string output_dir, unsigned width = 32, bool header_only = false, TableBlob *blob = 0, bool split_cold = false)
+		: output_dir(output_dir), width(width), header_only(header_only), blob(blob), split_cold(split_cold), segmenter(false), segmenter_test(false), mask_test(false), table_count(0),
+		  cold_count(0), in_cold(false), known_bits(0), known_value(0) {}
 	
 	virtual void visit(IPredicate &predicate);
 	virtual void visit(TerminalPredicate &predicate);
 	virtual void visit(AndPredicate &predicate);
 	virtual void visit(OrPredicate &predicate);
 	virtual void visit(TernaryPredicate &predicate);
+	virtual void visit(TablePredicate &predicate);
+	virtual void visit(RangePredicate &predicate);
+	virtual void visit(HashPredicate &predicate);
+	void visit_branch(IPredicate &predicate, codevalue bits, codevalue value);
 	
-	virtual void generate(std::string classer_name, Predicate &p, codevalue_vector *test_codes = 0, bool profiler = false);
+	virtual void generate(std::string classer_name, Predicate &p, range_list *test_ranges = 0, bool profiler = false, Predicate *bmp_predicate = 0, SimdKernel *simd = 0, range_list *dont_care = 0);
 	void generate_main(bool test, bool profiler);
 	void generate_classer(std::string classer_name, IPredicate &predicate, bool profiler);
-	void generate_test(std::string classer_name, codevalue_vector &codes, bool profiler);
+	void generate_cold(IPredicate &predicate);
+	void generate_utf16(std::string classer_name, IPredicate &bmp_predicate);
+	void generate_simd(std::string classer_name, SimdKernel &kernel);
+	std::string generate_declarations(std::string classer_name, bool utf16, bool simd);
+	void generate_test(std::string classer_name, range_list &ranges, range_list *dont_care, bool profiler, bool utf16, bool simd);
+	bool generate_dont_care(range_list *dont_care);
 	void generate_header(bool profiler);
 	void generate_test_header();
 	void generate_profiler();
+	void generate_tables_loader();
+	virtual void restore(std::string classer_name, generated_files &files);
+	virtual generated_files& last_generated() { return generated; }
+	virtual void generate_segmenter(ClassTable &table, bool test, range_list *dont_care = 0);
+	void generate_segmenter_test(range_list *dont_care);
+	virtual void generate_mask(ClassTable &table, bool test, range_list *dont_care = 0);
+	void generate_mask_tree(ClassTable &table, size_t first, size_t last, unsigned depth);
+	void generate_mask_test(range_list *dont_care);
+	std::string generate_classes();
+	void generate_class_lookup(ClassTable &table, std::string name);
 	virtual void finalize(bool test, bool profiler);
 
 	void out_open(std::string filename, char * const what = 0);
 	void out_close();
+	void out_with_tables(const std::string &code);
+	void out_write(std::string filename, const std::string &content, const char * const what = 0);
+
+	std::string codevalue_type();
+	std::string linkage(bool internal = false);
 
 	std::string output_dir, prefix;
-	std::vector<std::string> classers;
-	std::ofstream out;
+	unsigned width;		// bits of the codevalues that classifiers take, as in MatchTree
+	bool header_only;	// classifiers are defined inline in headers of their own
+	TableBlob *blob;	// if given, tables are written to it rather than to the code
+	bool split_cold;	// subtrees that only astral codevalues reach are outlined
+	std::vector<std::string> classers, declarations;
+	bool segmenter;		// generated, so its classes and tables can be shared
+	bool segmenter_test, mask_test;
+	std::ostringstream out;
+	std::string out_filename;
+	const char *out_what;
+	generated_files generated;
+	std::ostringstream tables;	// tables used by the function being generated
+	std::string table_prefix;
+	unsigned table_count;
+	std::ostringstream cold;	// outlined subtrees of the function being generated
+	unsigned cold_count;
+	bool in_cold;
+	uint32_t known_bits, known_value;	// of every codevalue that reaches the predicate being visited
 };
 
 #endif
\ No newline at end of file
@@ -5,9 +5,20 @@
 #ifndef GENERATOR_H
 #define GENERATOR_H
 
+#include <string>
+#include <utility>
 #include <vector>
+#include "range_list.hpp"
 
 struct IGenerator;
+struct ClassTable;
+struct SimdKernel;
+
+typedef std::vector<std::pair<std::string, std::string> > generated_files; // pairs of (filename, content)
+
+// generated_files may also carry a classifier's declarations for the combined
+// header, under this name, so that a cached classifier can be declared too
+#define DECLARATIONS ":declarations"
 
 struct IGeneratable
 {
@@ -23,8 +34,18 @@ struct IGenerator
 	virtual void visit(AndPredicate &predicate) = 0;
 	virtual void visit(OrPredicate &predicate) = 0;
 	virtual void visit(TernaryPredicate &predicate) = 0;
+	virtual void visit(TablePredicate &predicate) = 0;
+	virtual void visit(RangePredicate &predicate) = 0;
+	virtual void visit(HashPredicate &predicate) = 0;
 	
-	virtual void generate(std::string classer_name, Predicate &p, codevalue_vector *test_codes, bool profiler) = 0;
+	// bmp_predicate, if given, matches the BMP part of p, and asks for UTF-16 entry points.
+	// simd, if also given, asks for a vectorized UTF-16 batch entry point as well.
+	// dont_care, if given, holds codevalues that p may or may not match, which are not tested
+	virtual void generate(std::string classer_name, Predicate &p, range_list *test_ranges, bool profiler, Predicate *bmp_predicate, SimdKernel *simd, range_list *dont_care) = 0;
+	virtual void restore(std::string classer_name, generated_files &files) = 0;	// re-emit files of a cached classifier
+	virtual generated_files& last_generated() = 0;	// files emitted by the last generate() call
+	virtual void generate_segmenter(ClassTable &table, bool test, range_list *dont_care = 0) {}	// a run segmenter over all classifiers, if supported
+	virtual void generate_mask(ClassTable &table, bool test, range_list *dont_care = 0) {}	// a fused classifier of all classifiers, if supported; after any segmenter
 	virtual void finalize(bool test, bool profiler) = 0;
 };
 
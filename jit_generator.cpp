@@ -0,0 +1,253 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "jit_generator.hpp"
+
+using namespace std;
+
+
+//----- visit() methods -------------------------------------------------------
+
+void JitGenerator::visit(IPredicate &predicate)
+{
+	predicate.accept(*this); // cause predicate to call visit() again with the proper class as argument
+}
+
+void JitGenerator::visit(TerminalPredicate &predicate)
+{
+	bool eq = predicate.should_succeed;
+	codevalue m = predicate.tested_bits, v = predicate.tested_value & m;
+
+	if (m == 0) target = eq ? on_match : on_miss;	// a constant is just a jump
+	else
+	{
+		target = code.size();
+		emit_test((uint32_t)m, (uint32_t)v, eq ? on_match : on_miss, eq ? on_miss : on_match);
+	}
+}
+
+void JitGenerator::visit(AndPredicate &predicate)
+{
+	uint32_t rhs = compile(*predicate.rhs, on_match, on_miss);
+	target = compile(*predicate.lhs, rhs, on_miss);
+}
+
+void JitGenerator::visit(OrPredicate &predicate)
+{
+	uint32_t rhs = compile(*predicate.rhs, on_match, on_miss);
+	target = compile(*predicate.lhs, on_match, rhs);
+}
+
+void JitGenerator::visit(TernaryPredicate &predicate)
+{
+	uint32_t on = compile(*predicate.on, on_match, on_miss);
+	uint32_t off = compile(*predicate.off, on_match, on_miss);
+	target = compile(*predicate.predicate, on, off);
+}
+
+void JitGenerator::visit(TablePredicate &predicate)
+{
+	// the bitmap is placed right before its code, where it is never executed
+	uint32_t bitmap = code.size();
+	code.insert(code.end(), predicate.bits.begin(), predicate.bits.end());
+	target = code.size();
+	emit_table(bitmap, (uint32_t)predicate.base, (uint32_t)predicate.size, on_match, on_miss);
+}
+
+void JitGenerator::visit(RangePredicate &predicate)
+{
+	target = code.size();
+	emit_range((uint32_t)predicate.first, (uint32_t)predicate.size, on_match, on_miss);
+}
+
+void JitGenerator::visit(HashPredicate &predicate)
+{
+	// the displacements and slots are placed right before the code, like the bitmap of a table
+	uint32_t table = code.size();
+	for (size_t i = 0, n = predicate.displacements.size(); i < n; ++i) emit32(predicate.displacements[i]);
+	for (size_t i = 0, n = predicate.slots.size(); i < n; ++i) emit32(predicate.slots[i]);
+	target = code.size();
+	emit_hash(table, predicate.multiplier, predicate.shift, predicate.displacements.size(), predicate.slots.size(), on_match, on_miss);
+}
+
+
+//----- Machine code ----------------------------------------------------------
+
+// The classifier follows the System V AMD64 calling convention: c arrives in
+// edi, and the result is returned in eax. Each test is at most 23 bytes:
+//
+//		mov eax, edi / and eax, mask / cmp eax, value	(or a single test/cmp edi)
+//		je match
+//		jmp miss
+//
+// A range is a subtract and an unsigned compare. A table is its bitmap,
+// followed by a range check and a bit test into it. A hash is its
+// displacements and slots, followed by a multiply-shift that loads the
+// displacement, a second multiply that scales it to a slot, and a compare
+// with the slot.
+
+void JitGenerator::emit32(uint32_t x)
+{
+	for (int i = 0; i < 4; ++i, x >>= 8) code.push_back(x & 0xFF);
+}
+
+void JitGenerator::emit_jump(unsigned char short_opcode, const char *near_opcode, uint32_t to)
+{
+	// all targets were emitted before us, so jumps are always backward
+	long rel = (long)to - (long)(code.size() + 2);
+	if (rel >= -128)
+	{
+		code.push_back(short_opcode);
+		code.push_back((unsigned char)rel);
+	}
+	else
+	{
+		size_t n = strlen(near_opcode);
+		emit(near_opcode, n);
+		emit32((uint32_t)((long)to - (long)(code.size() + 4)));
+	}
+}
+
+void JitGenerator::emit_test(uint32_t mask, uint32_t value, uint32_t match, uint32_t miss)
+{
+	if (value == 0 && mask != 0xFFFFFFFF)
+	{
+		emit("\xF7\xC7", 2);	// test edi, mask
+		emit32(mask);
+	}
+	else if (mask == 0xFFFFFFFF)
+	{
+		emit("\x81\xFF", 2);	// cmp edi, value
+		emit32(value);
+	}
+	else
+	{
+		emit("\x89\xF8\x25", 3);	// mov eax, edi / and eax, mask
+		emit32(mask);
+		code.push_back(0x3D);		// cmp eax, value
+		emit32(value);
+	}
+	emit_jump(0x74, "\x0F\x84", match);	// je match
+	emit_jump(0xEB, "\xE9", miss);		// jmp miss
+}
+
+void JitGenerator::emit_range(uint32_t first, uint32_t size, uint32_t match, uint32_t miss)
+{
+	emit("\x89\xF8\x2D", 3);			// mov eax, edi / sub eax, first
+	emit32(first);
+	code.push_back(0x3D);				// cmp eax, size
+	emit32(size);
+	emit_jump(0x72, "\x0F\x82", match);	// jb match
+	emit_jump(0xEB, "\xE9", miss);		// jmp miss
+}
+
+void JitGenerator::emit_hash(uint32_t table, uint32_t multiplier, uint32_t shift, uint32_t buckets, uint32_t slots, uint32_t match, uint32_t miss)
+{
+	emit("\x89\xF8\x69\xC0", 4);		// mov eax, edi / imul eax, eax, multiplier
+	emit32(multiplier);
+	emit("\xC1\xE8", 2);				// shr eax, shift
+	code.push_back((unsigned char)shift);
+	emit("\x48\x8D\x15", 3);			// lea rdx, [rip + table]
+	emit32(table - (code.size() + 4));
+	emit("\x8B\x04\x82\x31\xF8", 5);	// mov eax, [rdx + rax*4] / xor eax, edi
+	emit("\x69\xC0", 2);				// imul eax, eax, multiplier
+	emit32(multiplier);
+	emit("\x48\x69\xC0", 3);			// imul rax, rax, slots
+	emit32(slots);
+	emit("\x48\xC1\xE8\x20", 4);		// shr rax, 32
+	emit("\x3B\xBC\x82", 3);			// cmp edi, [rdx + rax*4 + buckets*4]
+	emit32(buckets * 4);
+	emit_jump(0x74, "\x0F\x84", match);	// je match
+	emit_jump(0xEB, "\xE9", miss);		// jmp miss
+}
+
+void JitGenerator::emit_table(uint32_t bitmap, uint32_t base, uint32_t size, uint32_t match, uint32_t miss)
+{
+	emit("\x89\xF8\x2D", 3);			// mov eax, edi / sub eax, base
+	emit32(base);
+	code.push_back(0x3D);				// cmp eax, size
+	emit32(size);
+	emit_jump(0x73, "\x0F\x83", miss);	// jae miss
+	emit("\x48\x8D\x15", 3);			// lea rdx, [rip + bitmap]
+	emit32(bitmap - (code.size() + 4));
+	emit("\x0F\xA3\x02", 3);			// bt [rdx], eax (reads the whole dword holding the bit)
+	emit_jump(0x72, "\x0F\x82", match);	// jc match
+	emit_jump(0xEB, "\xE9", miss);		// jmp miss
+}
+
+
+//----- compile() -------------------------------------------------------------
+
+uint32_t JitGenerator::compile(IPredicate &predicate, uint32_t match, uint32_t miss)
+{
+	uint32_t m = on_match, n = on_miss;
+	on_match = match;
+	on_miss = miss;
+	predicate.accept(*this);
+	on_match = m;
+	on_miss = n;
+	return target;
+}
+
+uint32_t JitGenerator::assemble(Predicate &p)
+{
+	unmap();
+	code.clear();
+	emit("\xB8\x01\x00\x00\x00\xC3", 6);	// accept: mov eax, 1 / ret
+	emit("\x31\xC0\xC3", 3);				// reject: xor eax, eax / ret
+	return compile(p, accept, reject);
+}
+
+void JitGenerator::generate(string classer_name, Predicate &p, range_list *test_ranges, bool profiler, Predicate *bmp_predicate, SimdKernel *simd, range_list *dont_care)
+{
+	uint32_t entry = assemble(p);
+	if (map()) function = (jit_function)((unsigned char *)page + entry);
+}
+
+#if defined(__x86_64__)
+
+bool JitGenerator::map()
+{
+	long system_page = sysconf(_SC_PAGESIZE);
+	page_size = (code.size() + system_page - 1) / system_page * system_page;
+	page = mmap(0, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (page == MAP_FAILED)
+	{
+		cerr << "Error: Could not map " << page_size << " bytes for the JIT compiled classifier." << endl;
+		page = 0;
+		return false;
+	}
+
+	// never leave the page writable and executable at the same time
+	memcpy(page, &code[0], code.size());
+	if (mprotect(page, page_size, PROT_READ | PROT_EXEC) != 0)
+	{
+		cerr << "Error: Could not make the JIT compiled classifier executable." << endl;
+		unmap();
+		return false;
+	}
+	return true;
+}
+
+#else
+
+bool JitGenerator::map()
+{
+	cerr << "Error: The JIT compiler supports only x86-64." << endl;
+	return false;
+}
+
+#endif
+
+void JitGenerator::unmap()
+{
+	if (page != 0) munmap(page, page_size);
+	page = 0;
+	page_size = 0;
+	function = 0;
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef JIT_GENERATOR_H
+#define JIT_GENERATOR_H
+
+#include <vector>
+#include <stdint.h>
+#include "generator.hpp"
+
+typedef bool (*jit_function)(uint32_t c);
+
+
+//----- JitGenerator ----------------------------------------------------------
+
+// Emits x86-64 machine code for a predicate into an executable page, so that
+// classifiers defined at runtime get the same compare/jump structure as the
+// generated C++ code without a compiler in the loop. Like BytecodeCompiler,
+// children are emitted before their parent so that every jump target is
+// already known. Each generate() call replaces the previously compiled
+// function, so use one JitGenerator per classifier.
+struct JitGenerator : public IGenerator
+{
+	JitGenerator() : function(0), page(0), page_size(0) {}
+	virtual ~JitGenerator() { unmap(); }
+
+	virtual void visit(IPredicate &predicate);
+	virtual void visit(TerminalPredicate &predicate);
+	virtual void visit(AndPredicate &predicate);
+	virtual void visit(OrPredicate &predicate);
+	virtual void visit(TernaryPredicate &predicate);
+	virtual void visit(TablePredicate &predicate);
+	virtual void visit(RangePredicate &predicate);
+	virtual void visit(HashPredicate &predicate);
+
+	virtual void generate(std::string classer_name, Predicate &p, range_list *test_ranges = 0, bool profiler = false, Predicate *bmp_predicate = 0, SimdKernel *simd = 0, range_list *dont_care = 0);
+	virtual void restore(std::string classer_name, generated_files &files) {}
+	virtual generated_files& last_generated() { return generated; }
+	virtual void finalize(bool test, bool profiler) {}
+
+	uint32_t assemble(Predicate &p);	// fills code without mapping it, returning the entry offset
+	uint32_t compile(IPredicate &predicate, uint32_t on_match, uint32_t on_miss);
+	void emit_test(uint32_t mask, uint32_t value, uint32_t match, uint32_t miss);
+	void emit_range(uint32_t first, uint32_t size, uint32_t match, uint32_t miss);
+	void emit_hash(uint32_t table, uint32_t multiplier, uint32_t shift, uint32_t buckets, uint32_t slots, uint32_t match, uint32_t miss);
+	void emit_table(uint32_t bitmap, uint32_t base, uint32_t size, uint32_t match, uint32_t miss);
+	void emit_jump(unsigned char short_opcode, const char *near_opcode, uint32_t to);
+	void emit(const char *bytes, size_t n) { code.insert(code.end(), bytes, bytes + n); }
+	void emit32(uint32_t x);
+
+	bool map();
+	void unmap();
+
+	jit_function function;	// the compiled classifier, or 0 if compilation failed
+	std::vector<unsigned char> code;
+	void *page;
+	size_t page_size;
+
+	uint32_t on_match, on_miss, target;	// state of the compile() in progress
+	generated_files generated;
+
+	static const uint32_t accept = 0, reject = 6;	// offsets of the return true/false stubs
+};
+
+#endif
@@ -4,20 +4,57 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
+#include <new>
 #include <sstream>
 #include "unistd.h"
+#include <getopt.h>
+#include <pthread.h>
 #include "unicode_data.hpp"
 #include "match_tree.hpp"
 #include "predicate.hpp"
 #include "cpp_generator.hpp"
 #include "c_generator.hpp"
+#include "cache.hpp"
+#include "runtime_classifier.hpp"
+#include "jit_generator.hpp"
+#include "bytecode.hpp"
+#include "class_table.hpp"
+#include "set_expression.hpp"
+#include "optimizer.hpp"
+#include "simd_kernel.hpp"
+#include "stats.hpp"
+#include "table_blob.hpp"
 
 using namespace std;
 
 
+//----- Allocation counting ---------------------------------------------------
+
+// every allocation of the generator is counted, so that the stages can be
+// compared by the number of their allocations as well. The replacement is
+// here rather than in stats.cpp, so that programs linking the runtime library
+// keep their own allocator.
+
+void* operator new(size_t size) throw(bad_alloc)
+{
+	++Stats::allocations;	// of the calling thread, so that classifiers built at once (-j) are counted apart
+	void *p = malloc(size == 0 ? 1 : size);
+	if (p == 0) throw bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) throw() __attribute__((noinline));	// inlined into a delete, free() looks mismatched to gcc
+
+void operator delete(void *p) throw()
+{
+	free(p);
+}
+
+
 void short_help_message()
 {
-	cout << "usage: uniclasser [-tp] [-u path] categories" << endl
+	cout << "usage: uniclasser [-tpcbilrvUksM] [-w bits] [-d spec] [-m file] [-S bytes] [-O effort] [-W weights] [-H codevalues] [-j threads] [-u path] [-f file] [--all] [--stats] [--trace file] [--report file] categories" << endl
 		 << "type uniclasser without any arguments for help." << endl;
 }
 
@@ -25,28 +62,340 @@ void help_message()
 {
 	cout << "generates highly efficient classifiers for Unicode characters based" << endl 
 		 << "on their properties." << endl 
-		 << "usage:  uniclasser [-tp] [-u path] categories" << endl
+		 << "usage:  uniclasser [-tpcbilrvUksM] [-w bits] [-d spec] [-m file] [-S bytes] [-O effort] [-W weights] [-H codevalues]" << endl
+		 << "                   [-j threads] [-u path] [-f file] [--all] [--stats] [--trace file] [--report file] categories" << endl
 		 << "options:" << endl 
 		 << "  -t        do not generate classifier test functions." << endl 
 		 << "  -p        generate profiling information (not suitable for production code)." << endl 
 		 << "  -c        generate C code (instead of the default C++)." << endl 
+		 << "  -b        generate classifier bytecode files, and C and C++ interpreters for them." << endl 
+		 << "  -i        generate header-only classifiers: static inline definitions and their tables" << endl
+		 << "            in a header per classifier, which callers can inline into their loops." << endl 
+		 << "  -l        split every classifier into a hot function and cold helper functions for the" << endl
+		 << "            subtrees of the astral planes, which are not inlined and are placed apart." << endl 
+		 << "  -m file   write all tables to file, a binary blob that the generated code maps into" << endl
+		 << "            memory with uniclasser_load_tables(), rather than compiling them in." << endl 
+		 << "  -U        generate UTF-16 entry points for every classifier." << endl 
+		 << "  -k        generate a vectorized UTF-16 batch entry point as well, using pshufb lookup" << endl
+		 << "            tables on 16 (SSSE3) or 32 (AVX2) code units at a time (implies -U)." << endl 
+		 << "  -s        generate uniclasser_segment(), which splits text into maximal runs of" << endl
+		 << "            characters that match the same classifiers (up to 32 classifiers)." << endl 
+		 << "  -M        generate uniclasser_mask(), which returns the bitmask of all the classifiers" << endl
+		 << "            that match a character, from a single lookup (up to 32 classifiers)." << endl 
+		 << "  -w bits   the width of the codevalues that classifiers take: 32 (the default) for any" << endl
+		 << "            wchar_t, 21 for unicode scalar values, or 16 for BMP code units only. Narrower" << endl
+		 << "            classifiers do not test the bits above their width." << endl
+		 << "  -d spec   a set expression of codevalues that no classifier will be given, like" << endl
+		 << "            'Cn|Cs', which classifiers may match or not, whichever is smaller." << endl
+		 << "  -S bytes  trade speed for size, by replacing dense subtrees with bitmap tables," << endl
+		 << "            until the estimated size of every classifier fits in bytes." << endl 
+		 << "  -O effort search for the predicate with the least expected compare/jumps, trying" << endl
+		 << "            effort split bits at every step (the default is a fast greedy build)." << endl 
+		 << "  -W a:b:c  weights of ASCII, other BMP and astral codevalues in the expected" << endl
+		 << "            compare/jumps (default: 1:1:1, i.e. all codevalues are equally likely)." << endl 
+		 << "  -H codevalues  match a set of up to this many codevalues with a perfect hash" << endl
+		 << "            (a multiply-shift that loads a displacement, a second multiply that picks" << endl
+		 << "            the slot, and a compare), when the predicate takes more than three compare/jumps." << endl 
+		 << "  -j threads  build the match trees and predicates of all classifiers on this many" << endl
+		 << "            threads (default: 1, or the number of processors with --all). Threads" << endl
+		 << "            left over by fewer classifiers build the planes of each tree in parallel." << endl 
+		 << "  -r        regenerate all classifiers, ignoring previously cached ones." << endl 
+		 << "  -v        verify every classifier by JIT compiling its predicate to x86-64 code," << endl
+		 << "            and comparing it against the predicate for every codevalue." << endl 
 		 << "  -u path   read unicode data from specified path (default: ./UnicodeData.txt)." << endl 
 		 << "            You can download the unicode data of the latest unicode version from:" << endl
-		 << "            http://www.unicode.org/Public/UNIDATA/UnicodeData.txt" << endl;
+		 << "            http://www.unicode.org/Public/UNIDATA/UnicodeData.txt" << endl
+		 << "  -f file   also read a UCD property file, like Scripts.txt, PropList.txt or" << endl
+		 << "            DerivedCoreProperties.txt, whose values (Latin, White_Space, XID_Start)" << endl
+		 << "            can then be used in categories. May be given several times, and all the" << endl
+		 << "            files are read in parallel." << endl
+		 << "  --all     generate a classifier for every general category in the unicode data, which" << endl
+		 << "            are all filtered in a single pass, before the classifiers of any categories." << endl
+		 << "  --stats   report the wall time, cpu time, peak RSS and allocations of every stage" << endl
+		 << "            (parse, filter, tree, predicate, verify, emit and finalize) per classifier." << endl
+		 << "  --trace file  write the stages to file as Chrome trace events (chrome://tracing)." << endl
+		 << "  --report file  write the metrics of every classifier to file as JSON: codevalues," << endl
+		 << "            nodes, compare/jumps (total, max and mean), sizes and generation time." << endl
+		 << "categories:" << endl
+		 << "  every argument is a set expression, which creates a classifier of its own:" << endl
+		 << "  a|b or a,b (union), a&b (intersection), a-b (difference), !a (complement)," << endl
+		 << "  (a) and [a b c] (union of items), over general categories (Lu), major" << endl
+		 << "  classes (L), LC, Cn, ASCII, Assigned, Any, property values (with -f) and" << endl
+		 << "  codevalues (U+0370..U+03FF)." << endl
+		 << "  for example: uniclasser 'L&!Lo' 'Nd-ASCII' '[Zs Zl Zp]'" << endl;
+}
+
+UnicodeData* load_unicode_data(string data_filename)
+{
+	cout << "Reading " << data_filename << " file..." << endl;
+	auto_ptr<UnicodeData> unicode(new UnicodeData(data_filename));
+	if (unicode->count() == 0) return 0;
+	cout << "Read " << unicode->count() << " codevalues." << endl;
+	return unicode.release();
+}
+
+struct PropertyLoad
+{
+	string filename;
+	PropertyFile *file;
+	pthread_t thread;
+	bool started;
+	unsigned long allocations;
+};
+
+void* load_property_file(void *load)
+{
+	PropertyLoad *l = (PropertyLoad*)load;
+	unsigned long allocations = Stats::allocations;
+	l->file = new PropertyFile(l->filename);
+	l->allocations = Stats::allocations - allocations;
+	return 0;
+}
+
+bool load_unicode_data(auto_ptr<UnicodeData> &unicode, string data_filename, const vector<string> &property_filenames, Stats &stats)	// unless already loaded
+{
+	if (unicode.get() != 0) return true;
+	stats.begin("parse");
+	
+	// the property files are read on threads of their own, while UnicodeData.txt is read here
+	vector<PropertyLoad> loads(property_filenames.size());
+	for (size_t i = 0; i < loads.size(); ++i)
+	{
+		loads[i].filename = property_filenames[i];
+		loads[i].file = 0;
+		loads[i].started = pthread_create(&loads[i].thread, 0, load_property_file, &loads[i]) == 0;
+		if (!loads[i].started) load_property_file(&loads[i]);
+	}
+	unicode.reset(load_unicode_data(data_filename));
+	
+	bool loaded = unicode.get() != 0;
+	for (vector<PropertyLoad>::iterator i = loads.begin(); i != loads.end(); ++i)
+	{
+		if (i->started)
+		{
+			pthread_join(i->thread, 0);
+			Stats::allocations += i->allocations;	// counted in the parse stage of this thread
+		}
+		auto_ptr<PropertyFile> file(i->file);
+		if (!file->loaded) loaded = false;
+		if (!loaded) continue;
+		cout << "Read " << file->lines << " ranges of " << file->values.size() << " property values from " << file->filename << "." << endl;
+		unicode->add_properties(*file);
+	}
+	stats.end();
+	if (!loaded) unicode.reset();
+	return loaded;
+}
+
+range_list* clip_ranges(range_list *ranges, unsigned width)	// takes ownership of ranges, which may be 0
+{
+	if (ranges == 0 || width >= 21) return ranges;
+	auto_ptr<range_list> all(ranges);
+	range_list codevalues(1, coderange(0, MatchTree::last_codevalue(width)));
+	return range_intersection(*all, codevalues);
+}
+
+bool verify_classifier(Predicate &predicate, range_list &ranges, unsigned width, const range_list *dont_care)
+{
+	cout << "Verifying classifier predicate..." << endl;
+	JitGenerator jit;
+	jit.generate("", predicate);
+	if (jit.function == 0) return false;
+	auto_ptr<RuntimeClassifier> interpreted(RuntimeClassifier::build(predicate));
+	
+	// a narrower classifier is exact for all its codevalues, even beyond the unicode range
+	uint32_t last = width < 32 ? ((uint32_t)1 << width) - 1 : max_codevalue;
+	unsigned failed = 0, j = 0, n = ranges.size(), k = 0, m = dont_care != 0 ? dont_care->size() : 0;
+	for (uint32_t c = 0; c <= last; ++c)
+	{
+		bool b = j < n && c >= (uint32_t)ranges[j].first;
+		if (b && c == (uint32_t)ranges[j].second) ++j;
+		while (k < m && (uint32_t)(*dont_care)[k].second < c) ++k;
+		if (k < m && c >= (uint32_t)(*dont_care)[k].first) continue;
+		if (jit.function(c) != b || (*interpreted)(c) != b)
+		{
+			if (++failed <= 10) cerr << "Error: U+" << hex << c << dec << " should " << (b ? "" : "not ") << "match." << endl;
+		}
+	}
+	if (failed == 0) cout << "Verified " << last+1 << " codevalues against " << jit.code.size() << " bytes of x86-64 code." << endl;
+	else cerr << "Error: Verification failed for " << failed << " codevalues." << endl;
+	return failed == 0;
+}
+
+int fit_size_budget(range_list &ranges, unsigned width, auto_ptr<Predicate> &predicate, int compare_jump, unsigned &estimated_size, unsigned budget)
+{
+	// tables are first used only where they win big, and then wherever they
+	// are smaller than code at all, until the classifier fits the budget
+	for (unsigned factor = 16; factor > 0 && estimated_size > budget; factor /= 2)
+	{
+		MatchTree tree(ranges, width);
+		tree.table_factor = factor;
+		auto_ptr<Predicate> smaller(new Predicate);
+		int n = tree.create_predicate(*smaller);
+		assert(tree.count == 0);
+		if (tree.estimated_size(n) >= estimated_size) continue;
+		
+		predicate = smaller;
+		compare_jump = n;
+		estimated_size = tree.estimated_size(n);
+		cout << "Created a predicate with " << dec << n << " compare/jumps and " << tree.table_bytes << " bytes of tables." << endl;
+	}
+	if (estimated_size > budget) cerr << "Error: Could not fit the classifier in " << budget << " bytes. Using the smallest one found." << endl;
+	return compare_jump;
+}
+
+int optimize_predicate(range_list &ranges, unsigned width, auto_ptr<Predicate> &predicate, int compare_jump, const CodevalueWeights &weights, unsigned effort)
+{
+	cout << "Optimizing classifier predicate..." << endl;
+	PredicateOptimizer optimizer(ranges, weights, effort, width);
+	auto_ptr<Predicate> optimized(new Predicate);
+	int n = optimizer.create_predicate(*optimized);
+	double greedy = expected_compares(*predicate, weights), best = expected_compares(*optimized, weights);
+	cout << "Searched " << dec << optimizer.searched << " cubes. Expected compare/jumps per codevalue: " << greedy << " greedy, " << best << " optimized." << endl;
+	
+	// the greedy predicate is kept when the search did not beat it
+	if (best >= greedy) return compare_jump;
+	predicate = optimized;
+	cout << "Created a predicate with " << n << " compare/jumps." << endl;
+	return n;
+}
+
+int hash_predicate(range_list &ranges, auto_ptr<Predicate> &predicate, int compare_jump, unsigned &estimated_size)
+{
+	if (compare_jump <= HashPredicate::compare_jumps) return compare_jump;
+	
+	cout << "Building perfect hash..." << endl;
+	auto_ptr<HashPredicate> hash(HashPredicate::build(ranges));
+	if (hash.get() == 0)
+	{
+		cout << "Could not find a perfect hash. Using the predicate." << endl;
+		return compare_jump;
+	}
+	cout << "Created a perfect hash with " << dec << hash->slots.size() << " slots and " << hash->displacements.size() << " displacements, load factor " << hash->load_factor() << "." << endl;
+	
+	// the code of a hash is about twice that of a table
+	estimated_size = (hash->displacements.size() + hash->slots.size()) * 4 + 2 * MatchTree::table_code_bytes;
+	predicate.reset(new Predicate);
+	push_predicate(*predicate, hash.release());
+	return 1;
+}
+
+//----- Parallel build --------------------------------------------------------
+
+// A classifier whose match tree and predicate are built ahead of the main
+// loop, on one of several threads (-j). The main loop takes ownership of
+// ranges and predicate.
+struct ClassifierJob
+{
+	ClassifierJob() : ranges(0), predicate(0), tree_nodes(0), compare_jump(0) {}
+	
+	std::string name;
+	range_list *ranges;		// 0 if the classifier is cached
+	Predicate *predicate;	// 0 until built
+	unsigned tree_nodes;
+	int compare_jump;
+	Stats stats;	// of the thread that built it, merged by the main loop
+};
+
+struct ClassifierQueue
+{
+	ClassifierQueue(unsigned width, const range_list *dont_care) : width(width), dont_care(dont_care), tree_threads(1), threads(0), next(0) { pthread_mutex_init(&lock, 0); }
+	~ClassifierQueue() { pthread_mutex_destroy(&lock); }
+	
+	ClassifierJob* pop()
+	{
+		pthread_mutex_lock(&lock);
+		ClassifierJob *job = next < jobs.size() ? jobs[next++] : 0;
+		pthread_mutex_unlock(&lock);
+		return job;
+	}
+	
+	unsigned width;
+	const range_list *dont_care;
+	unsigned tree_threads;	// the threads a single tree is built on, when there are more threads than trees
+	unsigned threads;	// that took jobs so far, which numbers them in the stats
+	std::vector<ClassifierJob*> jobs;
+	size_t next;
+	pthread_mutex_t lock;
+};
+
+bool larger_job(const ClassifierJob *a, const ClassifierJob *b) { return a->ranges->size() > b->ranges->size(); }
+
+void* build_predicates(void *queue)
+{
+	ClassifierQueue &q = *(ClassifierQueue*)queue;
+	unsigned thread = __sync_add_and_fetch(&q.threads, 1);
+	while (ClassifierJob *job = q.pop())
+	{
+		job->stats.thread = thread;
+		job->stats.begin("tree", job->name);
+		MatchTree tree(*job->ranges, q.width, q.dont_care, q.tree_threads);
+		job->tree_nodes = tree.count;
+		job->stats.end();
+		
+		job->stats.begin("predicate", job->name);
+		auto_ptr<Predicate> predicate(new Predicate);
+		job->compare_jump = tree.create_predicate(*predicate);
+		assert(tree.count == 0);
+		job->predicate = predicate.release();
+		job->stats.end();
+	}
+	return 0;
+}
+
+void build_predicates(vector<ClassifierJob> &jobs, unsigned width, const range_list *dont_care, unsigned threads)
+{
+	// the largest trees are built first, so that no thread is left with one at the end
+	ClassifierQueue queue(width, dont_care);
+	for (vector<ClassifierJob>::iterator i = jobs.begin(); i != jobs.end(); ++i) if (i->ranges != 0) queue.jobs.push_back(&*i);
+	sort(queue.jobs.begin(), queue.jobs.end(), larger_job);
+	if (!queue.jobs.empty()) queue.tree_threads = max(threads / (unsigned)queue.jobs.size(), 1u);
+	cout << "Building " << queue.jobs.size() << " match trees and predicates on " << threads << " threads..." << endl;
+	
+	vector<pthread_t> workers;
+	for (unsigned t = 1; t < threads && t < queue.jobs.size(); ++t)
+	{
+		pthread_t worker;
+		if (pthread_create(&worker, 0, build_predicates, &queue) != 0) break;	// the threads started so far will do
+		workers.push_back(worker);
+	}
+	build_predicates(&queue);
+	for (vector<pthread_t>::iterator i = workers.begin(); i != workers.end(); ++i) pthread_join(*i, 0);
+}
+
+unsigned report_size(Predicate &predicate, unsigned estimated_size)
+{
+	JitGenerator jit;
+	jit.assemble(predicate);
+	cout << "Estimated size is " << dec << estimated_size << " bytes, actual size is " << jit.code.size() << " bytes of x86-64 code." << endl;
+	return jit.code.size();
 }
 
 int main (int argc, char * const argv[])
 {
 	cout << "uniclasser v" << VERSION << " built " << __DATE__ << endl << "See " << URL << endl;
 	
-	bool test = true, profiler = false;
-	string data_filename("./UnicodeData.txt"), output_dir("./");
+	bool test = true, profiler = false, use_cache = true, verify = false, utf16 = false, simd = false, segment = false, fused = false, show_stats = false, all = false, header_only = false, split_cold = false;
+	unsigned size_budget = 0, effort = 0, hash_threshold = 0, threads = 0, width = 32;
+	CodevalueWeights weights;
+	vector<string> property_filenames;
+	string weights_spec("1:1:1");
+	string data_filename("./UnicodeData.txt"), output_dir("./"), language("c++"), trace_filename, report_filename, dont_care_spec, blob_filename;
+	Stats stats;
+	Report report;
 
-	auto_ptr<IGenerator> generator(new CppGenerator(output_dir));
+	enum { stats_option = 256, trace_option, report_option, all_option };
+	static const option long_options[] = {
+		{ "all", no_argument, 0, all_option },
+		{ "stats", no_argument, 0, stats_option },
+		{ "trace", required_argument, 0, trace_option },
+		{ "report", required_argument, 0, report_option },
+		{ 0, 0, 0, 0 }
+	};
 	
 	opterr = 0;
 	int c;
-	while ((c = getopt(argc, argv, ":tpcu:")) != -1)
+	while ((c = getopt_long(argc, argv, ":tpcbilrvUksMw:d:m:S:O:W:H:j:u:f:", long_options, 0)) != -1)
 	{
 		switch (c)
 		{
@@ -57,17 +406,124 @@ int main (int argc, char * const argv[])
 				profiler = true;
 				break;
 			case 'c':
-				generator.reset(new CGenerator(output_dir));
+				language = "c";
+				break;
+			case 'b':
+				language = "bytecode";
+				break;
+			case 'i':
+				header_only = true;
+				break;
+			case 'l':
+				split_cold = true;
+				break;
+			case 'r':
+				use_cache = false;
+				break;
+			case 'v':
+				verify = true;
+				break;
+			case 'U':
+				utf16 = true;
+				break;
+			case 'k':
+				simd = utf16 = true;
+				break;
+			case 's':
+				segment = true;
+				break;
+			case 'M':
+				fused = true;
+				break;
+			case 'w':
+				width = strtoul(optarg, 0, 10);
+				if (width != 16 && width != 21 && width != 32)
+				{
+					cerr << "Option -w requires a width of 16, 21 or 32 bits." << endl;
+					short_help_message();
+					return 1;
+				}
+				break;
+			case 'd':
+				dont_care_spec = optarg;
+				break;
+			case 'm':
+				blob_filename = optarg;
+				break;
+			case 'S':
+				size_budget = strtoul(optarg, 0, 10);
+				if (size_budget == 0)
+				{
+					cerr << "Option -S requires a positive size in bytes." << endl;
+					short_help_message();
+					return 1;
+				}
+				break;
+			case 'O':
+				effort = strtoul(optarg, 0, 10);
+				if (effort == 0)
+				{
+					cerr << "Option -O requires a positive effort." << endl;
+					short_help_message();
+					return 1;
+				}
+				break;
+			case 'W':
+				weights_spec = optarg;
+				if (!weights.parse(optarg))
+				{
+					cerr << "Option -W requires three weights, of ASCII, BMP and astral codevalues (e.g. 100:10:1)." << endl;
+					short_help_message();
+					return 1;
+				}
+				break;
+			case 'H':
+				hash_threshold = strtoul(optarg, 0, 10);
+				if (hash_threshold == 0)
+				{
+					cerr << "Option -H requires a positive number of codevalues." << endl;
+					short_help_message();
+					return 1;
+				}
+				break;
+			case 'j':
+				threads = strtoul(optarg, 0, 10);
+				if (threads == 0)
+				{
+					cerr << "Option -j requires a positive number of threads." << endl;
+					short_help_message();
+					return 1;
+				}
 				break;
 			case 'u':
 				data_filename = optarg;
 				break;
+			case 'f':
+				property_filenames.push_back(optarg);
+				break;
+			case all_option:
+				all = true;
+				break;
+			case stats_option:
+				show_stats = stats.enabled = true;
+				break;
+			case trace_option:
+				trace_filename = optarg;
+				stats.enabled = true;
+				break;
+			case report_option:
+				report_filename = optarg;
+				stats.enabled = true;	// for the generation times
+				break;
 			case ':':
-				cerr << "Option -" << (char)optopt << " requires an argument." << endl;
+				if (optopt == trace_option || optopt == report_option) cerr << "Option --" << (optopt == trace_option ? "trace" : "report") << " requires a file name." << endl;
+				else cerr << "Option -" << (char)optopt << " requires an argument." << endl;
 				short_help_message();
 				return 1;
 			case '?':
-				if (isprint(optopt))
+				if (optopt == 0)
+					cerr << "Unknown option '" << argv[optind-1] << "'." << endl;
+				else if (isprint(optopt))
 					cerr << "Unknown option '-" << (char)optopt << "'." << endl;
 				else
 					cerr << "Unknown option character '" << hex << showbase << optopt << "'." << endl;
@@ -78,7 +534,7 @@ int main (int argc, char * const argv[])
 				abort();
 		}
 	}
-	if (optind >= argc)
+	if (optind >= argc && !all)
 	{
 		if (optind > 1)
 		{
@@ -88,35 +544,303 @@ int main (int argc, char * const argv[])
 		else help_message();
 		return 1;
 	}
+	if (utf16 && width == 16)
+	{
+		cerr << "Error: UTF-16 entry points need classifiers of at least 21 bits." << endl;
+		return 1;
+	}
+	if (width == 16) weights.astral = 0;	// such codevalues cannot even be given
 	
-	cout << "Reading " << data_filename << " file..." << endl;
-	UnicodeData unicode(data_filename);
-	if (unicode.count() == 0) return 1;
-	cout << "Read " << unicode.count() << " codevalues." << endl;
+	auto_ptr<TableBlob> blob(blob_filename.empty() ? 0 : new TableBlob(blob_filename));
+	auto_ptr<IGenerator> generator;
+	if (language == "c") generator.reset(new CGenerator(output_dir, width, header_only, blob.get(), split_cold));
+	else if (language == "bytecode") generator.reset(new BytecodeGenerator(output_dir));
+	else generator.reset(new CppGenerator(output_dir, width, header_only, blob.get(), split_cold));
+	
+	if (simd && language == "bytecode")
+	{
+		cerr << "Error: SIMD kernels can only be generated as C or C++ code." << endl;
+		return 1;
+	}
+	if (segment && language == "bytecode")
+	{
+		cerr << "Error: The segmenter can only be generated as C or C++ code." << endl;
+		return 1;
+	}
+	if (fused && language == "bytecode")
+	{
+		cerr << "Error: uniclasser_mask() can only be generated as C or C++ code." << endl;
+		return 1;
+	}
+	if (split_cold && language == "bytecode")
+	{
+		cerr << "Error: Cold subtrees can only be split off in C or C++ code." << endl;
+		return 1;
+	}
+	if (blob.get() != 0 && language == "bytecode")
+	{
+		cerr << "Error: A table blob can only be generated with C or C++ code." << endl;
+		return 1;
+	}
+	if (header_only && (language == "bytecode" || profiler))
+	{
+		cerr << "Error: Header-only classifiers can only be generated as C or C++ code, without profiling." << endl;
+		return 1;
+	}
+	
+	// Every classifier is keyed on a hash of all its inputs: the unicode data,
+	// the category spec, the options that affect the output, and the generator
+	// itself, as the contents of its executable, so that rebuilding any of its
+	// sources invalidates the cache. On a hit the cached files are re-emitted
+	// without even reading the unicode data (unless --all needs it for the
+	// list of categories).
+	Hash inputs;
+	if (!inputs.add_file("/proc/self/exe")) use_cache = false;	// the executable cannot be read, so nothing cached can be trusted
+	if (!inputs.add_file(data_filename)) use_cache = false;	// let UnicodeData report the error
+	for (vector<string>::iterator i = property_filenames.begin(); i != property_filenames.end(); ++i)
+		if (!inputs.add_file(*i)) use_cache = false;
+	stringstream options;
+	options << language << " i" << header_only << " l" << split_cold << " t" << test << " p" << profiler << " U" << utf16 << " k" << simd << " w" << width << " d" << dont_care_spec << " m" << blob_filename << " S" << size_budget << " O" << effort << " W" << weights_spec << " H" << hash_threshold;
+	inputs.add(options.str()).add(VERSION);
+	report.data_filename = data_filename;
+	report.options = options.str();
+	ClassifierCache cache(output_dir + ".uniclasser-cache/");
+	
+	auto_ptr<UnicodeData> unicode;
+	ClassTable segments;
+	
+	auto_ptr<range_list> dont_care;
+	if (!dont_care_spec.empty())
+	{
+		if (!load_unicode_data(unicode, data_filename, property_filenames, stats)) return 1;
+		dont_care.reset(clip_ranges(SetExpression(*unicode).evaluate(dont_care_spec.c_str()), width));
+		if (dont_care.get() == 0) return 1;
+		cout << "Don't-care spec '" << dont_care_spec << "' matched " << range_count(*dont_care) << " codevalues in " << dont_care->size() << " ranges." << endl;
+	}
+	
+	// with --all, the codevalues of all the general categories are split
+	// between them in a single pass over the unicode data
+	vector<string> specs;
+	vector<ClassifierJob> jobs;
+	if (all)
+	{
+		if (!load_unicode_data(unicode, data_filename, property_filenames, stats)) return 1;
+		
+		stats.begin("filter");
+		vector<range_list> categories;
+		unicode->partition_gc(categories);
+		for (map<wstring, UnicodeData::property_t>::iterator i = unicode->gc_map.begin(); i != unicode->gc_map.end(); ++i)
+		{
+			if (i->second == 0) continue;
+			specs.push_back(string(i->first.begin(), i->first.end()));
+			jobs.push_back(ClassifierJob());
+			range_list *ranges = new range_list;
+			ranges->swap(categories[i->second]);
+			jobs.back().ranges = clip_ranges(ranges, width);
+		}
+		stats.end();
+		cout << "Partitioned the codevalues into " << specs.size() << " general categories." << endl;
+		if (threads == 0) threads = max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+	}
+	specs.insert(specs.end(), argv + optind, argv + argc);
+	jobs.resize(specs.size());
+	vector<string> identifiers;
+	if (!SetExpression::identifiers(specs, identifiers)) return 1;
+	
+	if ((segment || fused) && specs.size() > ClassTable::max_classes)
+	{
+		cerr << "Error: " << (segment ? "The segmenter" : "uniclasser_mask()") << " supports at most " << ClassTable::max_classes << " classifiers." << endl;
+		return 1;
+	}
+	
+	vector<string> keys;
+	vector<generated_files> cached(specs.size());
+	for (size_t i = 0; i < specs.size(); ++i)
+	{
+		keys.push_back(Hash(inputs).add(specs[i]).hex());
+		// the segmenter, uniclasser_mask() and the report need the codevalues of all classifiers, and the blob their tables
+		if (use_cache && !verify && !segment && !fused && report_filename.empty() && blob.get() == 0 && cache.load(keys[i], cached[i]))
+		{
+			delete jobs[i].ranges;
+			jobs[i].ranges = 0;
+		}
+		else cached[i].clear();
+	}
+	
+	if (threads > 1)
+	{
+		// the trees are built concurrently, and everything else in order below
+		for (size_t i = 0; i < specs.size(); ++i)
+		{
+			if (!cached[i].empty() || jobs[i].ranges != 0) continue;
+			if (!load_unicode_data(unicode, data_filename, property_filenames, stats)) return 1;
+			stats.begin("filter", "uniclasser_" + identifiers[i]);
+			jobs[i].ranges = clip_ranges(SetExpression(*unicode).evaluate(specs[i].c_str()), width);
+			stats.end();
+			if (jobs[i].ranges == 0) return 1;
+		}
+		
+		// every classifier is timed on the thread that builds it
+		for (size_t i = 0; i < specs.size(); ++i)
+		{
+			jobs[i].name = "uniclasser_" + identifiers[i];
+			jobs[i].stats.enabled = stats.enabled;
+		}
+		build_predicates(jobs, width, dont_care.get(), threads);
+		for (size_t i = 0; i < specs.size(); ++i) stats.merge(jobs[i].stats);
+	}
 
-	for (int i = optind; i < argc; ++i) {
-		auto_ptr<codevalue_vector> codes(unicode.filter_multiple_gc(argv[i]));
-		cout << endl << "General Category '" << argv[i] << "' matched " << codes->size() << " codevalues." << endl;
+	for (size_t i = 0; i < specs.size(); ++i) {
+		string classer_name("uniclasser_");
+		classer_name += identifiers[i];
+		
+		const string &key = keys[i];
+		if (!cached[i].empty())
+		{
+			cout << endl << "Category spec '" << specs[i] << "' is unchanged (cache key " << key << ")." << endl;
+			stats.begin("emit", classer_name);
+			generator->restore(classer_name, cached[i]);
+			stats.end();
+			continue;
+		}
+		
+		if (jobs[i].ranges == 0)
+		{
+			if (!load_unicode_data(unicode, data_filename, property_filenames, stats)) return 1;
+			
+			stats.begin("filter", classer_name);
+			jobs[i].ranges = clip_ranges(SetExpression(*unicode).evaluate(specs[i].c_str()), width);
+			stats.end();
+			if (jobs[i].ranges == 0) return 1;
+		}
+		auto_ptr<range_list> ranges(jobs[i].ranges);
+		cout << endl << "Category spec '" << specs[i] << "' matched " << range_count(*ranges) << " codevalues in " << ranges->size() << " ranges." << endl;
 		
-		cout << "Building match tree..." << endl;
-		MatchTree tree(*codes);
-		cout << "Built match tree with " << dec << tree.count << " nodes." << endl;
+		if (segment || fused) segments.add(*ranges);
 		
-		cout << "Building classifier predicate..." << endl;
-		Predicate predicate;
-		int compare_jump = tree.create_predicate(predicate);
+		auto_ptr<Predicate> predicate(jobs[i].predicate);
+		if (predicate.get() == 0)
+		{
+			stats.begin("tree", classer_name);
+			cout << "Building match tree..." << endl;
+			MatchTree tree(*ranges, width, dont_care.get());
+			cout << "Built match tree with " << dec << tree.count << " nodes." << endl;
+			jobs[i].tree_nodes = tree.count;
+			stats.end();
+			
+			stats.begin("predicate", classer_name);
+			cout << "Building classifier predicate..." << endl;
+			predicate.reset(new Predicate);
+			jobs[i].compare_jump = tree.create_predicate(*predicate);
+			assert(tree.count == 0); // should consume all tree nodes
+		}
+		else
+		{
+			stats.begin("predicate", classer_name);
+			cout << "Built match tree with " << dec << jobs[i].tree_nodes << " nodes." << endl;
+		}
+		unsigned tree_nodes = jobs[i].tree_nodes;
+		int compare_jump = jobs[i].compare_jump;
 		cout << "Created a predicate with " << dec << compare_jump << " compare/jumps." << endl;
-		assert(tree.count == 0); // should consume all tree nodes
 		
-		string classer_name("uniclasser_");
-		classer_name += argv[i];
-		replace(classer_name.begin(), classer_name.end(), ',', '_');
-		generator->generate(classer_name, predicate, test ? codes.get() : 0, profiler);
+		// the predicates are built for the cover of the set (see range_cover()),
+		// which is tested and reported by the set itself
+		auto_ptr<range_list> cover(dont_care.get() != 0 ? range_cover(*ranges, *dont_care) : new range_list(*ranges));
+		if (effort > 0) compare_jump = optimize_predicate(*cover, width, predicate, compare_jump, weights, effort);
+		unsigned estimated_size = compare_jump * MatchTree::compare_jump_bytes;	// no tables yet, see fit_size_budget()
+		if (range_count(*ranges) <= hash_threshold) compare_jump = hash_predicate(*ranges, predicate, compare_jump, estimated_size);
+		if (size_budget > 0 && estimated_size > size_budget) compare_jump = fit_size_budget(*cover, width, predicate, compare_jump, estimated_size, size_budget);
+		unsigned code_size = report_size(*predicate, estimated_size);
+		int predicate_compare_jump = compare_jump;
 		
+		auto_ptr<Predicate> bmp_predicate;
+		auto_ptr<SimdKernel> kernel;
+		if (utf16)
+		{
+			// UTF-16 code units get a predicate of their own, which is built
+			// only from the BMP codevalues and is therefore smaller and faster
+			range_list bmp(1, coderange(0, 0xFFFF));
+			auto_ptr<range_list> bmp_ranges(range_intersection(*cover, bmp));
+			MatchTree bmp_tree(*bmp_ranges, 16);	// code units have no higher bits to test
+			bmp_predicate.reset(new Predicate);
+			compare_jump = bmp_tree.create_predicate(*bmp_predicate);
+			cout << "Created a BMP predicate with " << dec << compare_jump << " compare/jumps." << endl;
+			
+			if (simd)
+			{
+				kernel.reset(new SimdKernel(*bmp_ranges));
+				cout << "Created a SIMD kernel with " << kernel->mixed << " mixed blocks, leaving " << kernel->others << " blocks to scalar code." << endl;
+			}
+		}
+		stats.end();
+		
+		if (verify)
+		{
+			stats.begin("verify", classer_name);
+			bool verified = verify_classifier(*predicate, *ranges, width, dont_care.get());
+			stats.end();
+			if (!verified) return 1;
+		}
+		
+		stats.begin("emit", classer_name);
+		generator->generate(classer_name, *predicate, test ? ranges.get() : 0, profiler, bmp_predicate.get(), kernel.get(), dont_care.get());
+		cache.store(key, generator->last_generated());
+		stats.end();
+		
+		if (!report_filename.empty())
+		{
+			CompareProfile profile(*predicate, weights);
+			Report::Classifier r;
+			r.spec = specs[i];
+			r.name = classer_name;
+			r.codevalues = range_count(*ranges);
+			r.ranges = ranges->size();
+			r.tree_nodes = tree_nodes;
+			r.predicate_nodes = profile.nodes;
+			r.compare_jumps = predicate_compare_jump;
+			r.max_compares = profile.max;
+			r.mean_compares = profile.mean;
+			r.estimated_size = estimated_size;
+			r.code_size = code_size;
+			r.milliseconds = stats.wall(classer_name) / 1000;
+			report.classifiers.push_back(r);
+		}
+		
+		cout << endl;
+	}
+	
+	if (segment || fused)
+	{
+		stats.begin("emit", segment ? "uniclasser_segment" : "uniclasser_mask");
+		cout << "Building class table..." << endl;
+		segments.build();
+		cout << "Built class table with " << dec << segments.masks.size() << " classes, " << segments.stage2.size() / (1 << ClassTable::block_bits) << " distinct blocks and " << segments.run_starts.size() << " runs." << endl;
+		if (segment) generator->generate_segmenter(segments, test, dont_care.get());
+		if (fused) generator->generate_mask(segments, test, dont_care.get());
+		stats.end();
 		cout << endl;
 	}
 	
+	stats.begin("finalize");
 	generator->finalize(test, profiler);
+	stats.end();
+	
+	if (show_stats)
+	{
+		cout << "Stages:" << endl;
+		stats.report(cout);
+		cout << endl;
+	}
+	if (!trace_filename.empty() && !stats.write_trace(trace_filename))
+	{
+		cerr << "Error: Could not write trace file " << trace_filename << "." << endl;
+		return 1;
+	}
+	if (!report_filename.empty() && !report.write(report_filename))
+	{
+		cerr << "Error: Could not write report file " << report_filename << "." << endl;
+		return 1;
+	}
 	
 	cout << "Finished!" << endl;
 	
@@ -129,6 +853,5 @@ int main (int argc, char * const argv[])
 	Check why generated code does not handle multibyte characters input
 	Change general category property to be a bitfield
 	Add further properties
-	Add timing
 	
  */
@@ -4,10 +4,166 @@
 
 #include <ostream>
 #include <cassert>
+#include <memory>
+#include <pthread.h>
 #include "match_tree.hpp"
+#include "stats.hpp"
 
 using namespace std;
 
+MatchTree::MatchTree(const range_list &ranges, unsigned bits, const range_list *dont_care, unsigned threads) : root(top_bit(bits)), count(0), table_factor(0), table_bytes(0)
+{
+	if (dont_care == 0) add(ranges, threads);
+	else
+	{
+		auto_ptr<range_list> cover(range_cover(ranges, *dont_care));
+		add(*cover, threads);
+	}
+}
+
+MatchTree::MatchTree(codevalue_vector &list) : count(0), table_factor(0), table_bytes(0)
+{
+	auto_ptr<range_list> ranges(to_ranges(list));	// also ignores duplicates
+	add(*ranges);
+}
+
+void MatchTree::add(const range_list &ranges)
+{
+	// every range is split into the largest aligned blocks it contains, and
+	// each block is added as a single trimmed node, so building the tree
+	// takes time in the number of ranges rather than of codevalues
+	for (range_list::const_iterator i = ranges.begin(), e = ranges.end(); i != e; ++i)
+	{
+		uint32_t first = i->first, last = i->second;
+		while (first <= last)
+		{
+			uint32_t size = 1;
+			while (first % (size << 1) == 0 && first + (size << 1) - 1 <= last && size < (uint32_t)root.pos) size <<= 1;	// the root takes halves of its block
+			count += root.add((codevalue)first, (codevalue)size);
+			first += size;
+		}
+	}
+}
+
+//----- Parallel build ------------------------------------------------------
+
+namespace
+{
+	// The subtree of a single plane, rooted at the node of its top bit
+	struct Plane
+	{
+		Plane() : root(0), count(0) {}
+		
+		MatchTree::Node *root;
+		range_list blocks;
+		int count;
+	};
+	
+	struct PlaneQueue
+	{
+		PlaneQueue() : next(0), allocations(0) {}
+		
+		std::vector<Plane*> planes;
+		unsigned next;
+		unsigned long allocations;	// of the helper threads
+	};
+	
+	void* build_planes(void *queue)
+	{
+		PlaneQueue &q = *(PlaneQueue*)queue;
+		for (unsigned i; (i = __sync_fetch_and_add(&q.next, 1)) < q.planes.size(); )
+		{
+			Plane &plane = *q.planes[i];
+			for (range_list::const_iterator b = plane.blocks.begin(), e = plane.blocks.end(); b != e; ++b)
+				plane.count += plane.root->add(b->first, b->second - b->first + 1);
+		}
+		return 0;
+	}
+	
+	void* help_build_planes(void *queue)
+	{
+		unsigned long allocations = Stats::allocations;
+		build_planes(queue);
+		__sync_add_and_fetch(&((PlaneQueue*)queue)->allocations, Stats::allocations - allocations);
+		return 0;
+	}
+}
+
+void MatchTree::add(const range_list &ranges, unsigned threads)
+{
+	if (threads <= 1 || (uint32_t)root.pos <= plane_size)
+	{
+		add(ranges);
+		return;
+	}
+	
+	// the blocks are split as in add(ranges), and those of a whole plane or
+	// more are left to the root, after the planes are in place
+	PlaneQueue queue;
+	vector<Plane> planes;
+	range_list top;
+	for (range_list::const_iterator i = ranges.begin(), e = ranges.end(); i != e; ++i)
+	{
+		uint32_t first = i->first, last = i->second;
+		while (first <= last)
+		{
+			uint32_t size = 1;
+			while (first % (size << 1) == 0 && first + (size << 1) - 1 <= last && size < (uint32_t)root.pos) size <<= 1;
+			if (size >= plane_size) top.push_back(coderange(first, first + size - 1));
+			else
+			{
+				if (planes.size() <= first / plane_size) planes.resize(first / plane_size + 1);
+				planes[first / plane_size].blocks.push_back(coderange(first, first + size - 1));
+			}
+			first += size;
+		}
+	}
+	for (vector<Plane>::iterator i = planes.begin(); i != planes.end(); ++i)
+	{
+		if (i->blocks.empty()) continue;
+		i->root = new Node(plane_size >> 1);
+		i->count = 1;
+		queue.planes.push_back(&*i);
+	}
+	
+	vector<pthread_t> workers;
+	for (unsigned t = 1; t < threads && t < queue.planes.size(); ++t)
+	{
+		pthread_t worker;
+		if (pthread_create(&worker, 0, help_build_planes, &queue) != 0) break;	// the threads started so far will do
+		workers.push_back(worker);
+	}
+	build_planes(&queue);
+	for (vector<pthread_t>::iterator i = workers.begin(); i != workers.end(); ++i) pthread_join(*i, 0);
+	Stats::allocations += queue.allocations;	// counted as the caller's, in whatever stage it is timing
+	
+	for (uint32_t p = 0; p < planes.size(); ++p)
+	{
+		if (planes[p].root == 0) continue;
+		
+		// the nodes above the plane are created as add() would, and then the plane takes its place
+		uint32_t base = p * plane_size;
+		Node *node = &root;
+		while ((uint32_t)node->pos != plane_size)
+		{
+			Node *&child = (base & node->pos) ? node->on : node->off;
+			if (child == 0)
+			{
+				child = new Node(node, base & node->pos);
+				++count;
+			}
+			node = child;
+		}
+		Node *&child = (base & plane_size) ? node->on : node->off;
+		child = planes[p].root;
+		child->parent = node;
+		count += planes[p].count;
+		count += child->trimUp();	// a full plane is trimmed, and so may be the nodes above it
+	}
+	
+	add(top);
+}
+
 int MatchTree::prune_base(IPredicate &predicate, Node* &bottom, codevalue &mask, codevalue &val)
 {
 	int height = 0;
@@ -56,7 +212,7 @@ int MatchTree::prune_base(IPredicate &predicate, Node* &bottom, codevalue &mask,
 	}
 	
 	// all this pruning cost us only one comparison/jump!
-	assert(predicate.push(p));
+	push_predicate(predicate, p);
 	return 1;
 }
 
@@ -166,7 +322,7 @@ int MatchTree::prune_top(IPredicate &predicate, Node* &bottom, codevalue mask, c
 		remove_trimmed_child(lowest);
 		
 		// and finally add the additional compare/jump to the predicate, and report it back
-		assert(predicate.push(p));
+		push_predicate(predicate, p);
 		return 1;
 	}
 	else return 0;
@@ -183,6 +339,26 @@ void MatchTree::remove_trimmed_child(Node *node)
 }
 
 int MatchTree::create_predicate(IPredicate &predicate, Node* bottom, codevalue mask, codevalue val)
+{
+	range_list ranges;
+	if (!collect_ranges(ranges, bottom, block_base(bottom))) return create_bit_predicate(predicate, bottom, mask, val);
+	
+	// the bit tests are built aside, since building them consumes the subtree
+	Predicate bits;
+	unsigned tables = table_bytes;
+	int n = create_bit_predicate(bits, bottom, mask, val);
+	if ((unsigned)n <= ranges.size())
+	{
+		push_predicate(predicate, bits.predicate);
+		bits.predicate = 0;
+		return n;
+	}
+	
+	table_bytes = tables;	// any tables of the bit tests are dropped with them
+	return create_ranges(predicate, ranges);
+}
+
+int MatchTree::create_bit_predicate(IPredicate &predicate, Node* bottom, codevalue mask, codevalue val)
 {
 	int compare_jump = 0, n;
 	do
@@ -207,6 +383,9 @@ int MatchTree::create_predicate(IPredicate &predicate, Node* bottom, codevalue m
 	// no choice but to add a ternary test
 	if (bottom != 0 && bottom->on != 0 && bottom->off != 0)
 	{
+		// unless a table would be much smaller than the code of this subtree
+		if (table_factor > 0 && prefer_table(bottom)) return compare_jump + create_table(predicate, bottom);
+		
 		IPredicate *ternary = new TernaryPredicate(bottom->pos);
 		++compare_jump;
 		
@@ -214,7 +393,7 @@ int MatchTree::create_predicate(IPredicate &predicate, Node* bottom, codevalue m
 		compare_jump += create_predicate(*ternary, bottom->on, m, val | bottom->pos);
 		compare_jump += create_predicate(*ternary, bottom->off, m, val);
 		
-		assert(predicate.push(ternary));
+		push_predicate(predicate, ternary);
 	}
 	
 	return compare_jump;
@@ -225,14 +404,101 @@ int MatchTree::create_predicate(IPredicate &predicate)
 	// first handle two special cases
 	if (root.on == 0 && root.off == 0)
 	{
-		assert(predicate.push(new TerminalPredicate(false)));	// empty tree matches nothing
+		push_predicate(predicate, new TerminalPredicate(false));	// empty tree matches nothing
 		return 0;
 	}
 	else if (TRIMMED(root.on) && TRIMMED(root.off))
 	{	
-		assert(predicate.push(new TerminalPredicate(true)));	// full tree matches everything
+		push_predicate(predicate, new TerminalPredicate(true));	// full tree matches everything
 		return 0;
 	}
 	
-	return create_predicate(predicate, &root, LASTBIT(codevalue), 0);
+	return create_predicate(predicate, &root, root.pos, 0);
+}
+
+static void add_block(range_list &ranges, codevalue first, codevalue size)
+{
+	codevalue last = first + size - 1;
+	if (!ranges.empty() && ranges.back().second + 1 == first) ranges.back().second = last;
+	else ranges.push_back(coderange(first, last));
+}
+
+bool MatchTree::collect_ranges(range_list &ranges, Node* node, codevalue base)
+{
+	// walks the subtree in codevalue order, giving up as soon as there are too many ranges
+	if (TRIMMED(node->off)) add_block(ranges, base, node->pos);
+	else if (node->off != 0 && !collect_ranges(ranges, node->off, base)) return false;
+	
+	if (TRIMMED(node->on)) add_block(ranges, base | node->pos, node->pos);
+	else if (node->on != 0 && !collect_ranges(ranges, node->on, base | node->pos)) return false;
+	
+	return ranges.size() <= max_ranges;
+}
+
+int MatchTree::create_ranges(IPredicate &predicate, const range_list &ranges)
+{
+	// the ranges are tested in order, so the lower (and usually more common) codevalues go first
+	for (size_t i = 0, n = ranges.size(); i < n; ++i)
+	{
+		codevalue first = ranges[i].first, size = ranges[i].second - first + 1;
+		
+		// an aligned block, such as a single codevalue, needs no subtraction
+		IPredicate *p;
+		if ((size & (size - 1)) == 0 && (first & (size - 1)) == 0) p = new TerminalPredicate(true, ~(size - 1), first);
+		else p = new RangePredicate(first, size);
+		if (i + 1 < n) p = new OrPredicate(p);
+		push_predicate(predicate, p);
+	}
+	return ranges.size();
+}
+
+codevalue MatchTree::block_base(Node* node)
+{
+	codevalue base = 0;
+	for (; node->parent != 0; node = node->parent)
+		if (node->parent->on == node) base |= node->parent->pos;
+	return base;
+}
+
+bool MatchTree::prefer_table(Node* bottom)
+{
+	// the subtree of bottom covers the aligned block of the bits up to and including its pos
+	if (bottom->pos <= 0 || (unsigned)bottom->pos > max_table_size / 2) return false;
+	unsigned table = (unsigned)bottom->pos / 4 + table_code_bytes, code = subtree_nodes(bottom) * compare_jump_bytes;
+	return table * table_factor <= code;
+}
+
+int MatchTree::create_table(IPredicate &predicate, Node* bottom)
+{
+	codevalue base = block_base(bottom);
+	TablePredicate *table = new TablePredicate(base, bottom->pos * 2);
+	fill_table(*table, bottom, base);
+	table_bytes += table->bits.size() + table_code_bytes;
+	
+	// the table replaces the whole subtree, so remove it from the tree
+	count -= subtree_nodes(bottom) - 1;
+	bottom->removeOn();
+	bottom->removeOff();
+	if (bottom != &root) count += bottom->removeUp();
+	
+	push_predicate(predicate, table);
+	return 1;
+}
+
+void MatchTree::fill_table(TablePredicate &table, Node* node, codevalue base)
+{
+	codevalue on_base = base | node->pos;
+	if (TRIMMED(node->on)) table.set(on_base, on_base + node->pos - 1);
+	else if (node->on != 0) fill_table(table, node->on, on_base);
+	
+	if (TRIMMED(node->off)) table.set(base, base + node->pos - 1);
+	else if (node->off != 0) fill_table(table, node->off, base);
+}
+
+unsigned MatchTree::subtree_nodes(Node* node)
+{
+	unsigned n = 1;
+	if (node->on != 0 && !TRIMMED(node->on)) n += subtree_nodes(node->on);
+	if (node->off != 0 && !TRIMMED(node->off)) n += subtree_nodes(node->off);
+	return n;
 }
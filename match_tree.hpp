@@ -9,6 +9,7 @@
 #include <ostream>
 #include <string>
 #include "codevalue.hpp"
+#include "range_list.hpp"
 #include "predicate.hpp"
 
 #define LASTBIT(t) ((t)1<<(CHAR_BIT*sizeof(t)-1))
@@ -22,7 +23,7 @@ struct MatchTree
 	
 	struct Node
 	{
-		Node() : parent(0), on(0), off(0), pos(LASTBIT(codevalue)) {}
+		Node(codevalue pos = LASTBIT(codevalue)) : parent(0), on(0), off(0), pos(pos) {}
 		Node(Node *parent, bool on) : parent(parent), on(0), off(0), pos((parent->pos>>1)&(~parent->pos)) {}
 		
 		~Node() {
@@ -46,20 +47,20 @@ struct MatchTree
 			return n + trimUp();
 		}
 		
-		int add(codevalue x)
+		int add(codevalue x, codevalue size = 1)	// adds the aligned block of size codevalues at x
 		{
 			int n = 0;
 			Node *&node = (x & pos) ? on : off;
 			if (TRIMMED(node)) return n;
 			
-			if (node == 0 && pos != 1)
+			if (node == 0 && pos != size)
 			{
 				node = new Node(this, x & pos);
 				++n;
 			}
 			
-			if (pos == 1) node = (Node*)trimmed;
-			else n += node->add(x);
+			if (pos == size) node = (Node*)trimmed;
+			else n += node->add(x, size);
 			
 			n += trimUp();
 			return n;
@@ -89,26 +90,62 @@ struct MatchTree
 	
 	//----- MatchTree --------------------------------------------------------
 
-	MatchTree(codevalue_vector &list) : count(0)
-	{
-		codevalue last = -1;
-		for (codevalue_vector::iterator i = list.begin(), e = list.end(); i != e; ++i)
-		{
-			if (*i != last) // ignore duplicates
-				count += root.add(last = *i);
-		}
-	}
+	// A tree of bits codevalues only tests their lowest bits, so it matches
+	// only codevalues below 1 << bits, and all of ranges should lie there.
+	// Codevalues of dont_care may be matched or not, whichever takes fewer nodes
+	MatchTree(const range_list &ranges, unsigned bits = 32, const range_list *dont_care = 0, unsigned threads = 1);
+	MatchTree(codevalue_vector &list);	// list should be sorted
+	
+	void add(const range_list &ranges);
 	
+	// Builds the subtree of every plane on one of threads, and then links them
+	// under the root, where full planes are trimmed. The tree is the same as
+	// the one add(ranges) builds.
+	void add(const range_list &ranges, unsigned threads);
+	
+	static const uint32_t plane_size = 0x10000;
 	
 	int create_predicate(IPredicate &predicate);
 	int create_predicate(IPredicate &predicate, Node* bottom, codevalue mask, codevalue val);
+	int create_bit_predicate(IPredicate &predicate, Node* bottom, codevalue mask, codevalue val);
 	int prune_base(IPredicate &predicate, Node* &bottom, codevalue &mask, codevalue &val);
 	int prune_top(IPredicate &predicate, Node* &bottom, codevalue mask, codevalue val);
 	Node* check_branch(MatchTree::Node* bottom, codevalue &mask, codevalue &val);
 	void remove_trimmed_child(Node* node);
+	
+	static codevalue top_bit(unsigned bits) { return bits < CHAR_BIT*sizeof(codevalue) ? (codevalue)1 << (bits - 1) : LASTBIT(codevalue); }
+	static codevalue last_codevalue(unsigned bits) { return bits < 21 ? ((codevalue)1 << bits) - 1 : max_codevalue; }	// the last one a tree of bits can match
+	
+	//----- Ranges -----------------------------------------------------------
+	
+	// A subtree that covers at most max_ranges ranges of codevalues is also
+	// matched by a chain of RangePredicates, one compare/jump per range, which
+	// is used instead of the bit tests whenever it takes fewer compare/jumps.
+	
+	bool collect_ranges(range_list &ranges, Node* node, codevalue base);
+	int create_ranges(IPredicate &predicate, const range_list &ranges);
+	codevalue block_base(Node* node);
+	
+	static const unsigned max_ranges = 4;
+	
+	//----- Tables -----------------------------------------------------------
+	
+	// When table_factor is set, a subtree that would need a ternary test is
+	// replaced by a TablePredicate if the table is at least table_factor times
+	// smaller than the estimated code of the subtree. Sizes are in bytes.
+	
+	bool prefer_table(Node* bottom);
+	int create_table(IPredicate &predicate, Node* bottom);
+	void fill_table(TablePredicate &table, Node* node, codevalue base);
+	unsigned subtree_nodes(Node* node);
+	unsigned estimated_size(int compare_jump) { return compare_jump * compare_jump_bytes + table_bytes; }
+	
+	static const unsigned compare_jump_bytes = 16, table_code_bytes = 24, max_table_size = 0x20000;
 
 	Node root;
 	int count;
+	unsigned table_factor;
+	unsigned table_bytes;	// total size of all the tables created so far
 };
 
 
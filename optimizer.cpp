@@ -0,0 +1,253 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include "optimizer.hpp"
+#include "bytecode.hpp"
+
+using namespace std;
+
+
+//----- CodevalueWeights ------------------------------------------------------
+
+bool CodevalueWeights::parse(const char * const spec)
+{
+	char end;
+	return sscanf(spec, "%lf:%lf:%lf%c", &ascii, &bmp, &astral, &end) == 3 && ascii >= 0 && bmp >= 0 && astral >= 0;
+}
+
+// the number of c < n with (c & mask) == val
+static double count_below(uint32_t mask, uint32_t val, uint64_t n)
+{
+	double count = 0;
+	for (int i = 31; i >= 0; --i)
+	{
+		uint32_t bit = (uint32_t)1 << i;
+		bool nbit = (n & bit) != 0;
+		
+		// every c that agrees with n above bit i, and has a 0 where n has a 1, is below n
+		if (nbit && !(mask & bit & val)) count += ldexp(1.0, i - __builtin_popcount(mask & (bit - 1)));
+		
+		// otherwise keep following n, unless the mask forbids its bit
+		if ((mask & bit) && ((val & bit) != 0) != nbit) break;
+	}
+	return count;
+}
+
+double CodevalueWeights::of(uint32_t mask, uint32_t val) const
+{
+	val &= mask;
+	double a = count_below(mask, val, 0x80), b = count_below(mask, val, 0x10000), c = count_below(mask, val, (uint64_t)max_codevalue + 1);
+	return ascii * a + bmp * (b - a) + astral * (c - b);
+}
+
+CompareProfile::CompareProfile(Predicate &predicate, const CodevalueWeights &weights) : mean(0), max(0)
+{
+	BytecodeCompiler compiler;
+	compiler.generate("", predicate);
+	nodes = compiler.nodes;
+	
+	double steps = 0, total = 0;
+	for (uint32_t c = 0; c <= (uint32_t)max_codevalue; ++c)
+	{
+		unsigned n = 0;
+		for (uint32_t pc = compiler.entry; pc < BC_REJECT; ++n)
+		{
+			const bc_instruction &i = compiler.code[pc];
+			pc = bc_match(&i, c) ? i.match : i.miss;
+		}
+		double w = weights.of(c);
+		steps += w * n;
+		total += w;
+		if (w > 0 && n > max) max = n;
+	}
+	if (total > 0) mean = steps / total;
+}
+
+
+//----- PredicateOptimizer ----------------------------------------------------
+
+PredicateOptimizer::PredicateOptimizer(const range_list &ranges, const CodevalueWeights &weights, unsigned effort, unsigned bits) : weights(weights), effort(effort), width(1), searched(0), root(bits < 32 ? ~(((uint32_t)1 << bits) - 1) : 0, 0)
+{
+	// the same aligned blocks that MatchTree::add() builds its nodes from
+	for (range_list::const_iterator i = ranges.begin(), e = ranges.end(); i != e; ++i)
+	{
+		uint32_t first = i->first, last = i->second;
+		while (first <= last)
+		{
+			uint32_t size = 1;
+			while (first % (size << 1) == 0 && first + (size << 1) - 1 <= last) size <<= 1;
+			set.push_back(Cube(~(size - 1), first));
+			first += size;
+		}
+	}
+}
+
+int PredicateOptimizer::create_predicate(IPredicate &predicate)
+{
+	// a wider search may run out of cubes before it reaches the bottom, so
+	// every width up to effort is searched, and the best one is built
+	double best_cost = 0;
+	unsigned best_width = 1;
+	for (width = 1; width <= effort; ++width)
+	{
+		plans.clear();
+		double cost = plan(root, set).cost;
+		if (width == 1 || cost < best_cost)
+		{
+			best_cost = cost;
+			best_width = width;
+		}
+	}
+	
+	if (width - 1 != best_width)
+	{
+		plans.clear();
+		width = best_width;
+		plan(root, set);
+	}
+	return build(predicate, root, set);
+}
+
+void PredicateOptimizer::restrict(const cube_list &set, const Cube &cube, cube_list &result)
+{
+	for (cube_list::const_iterator i = set.begin(), e = set.end(); i != e; ++i)
+	{
+		if ((i->val ^ cube.val) & i->mask & cube.mask) continue;
+		result.push_back(Cube(i->mask | cube.mask, i->val | cube.val));
+	}
+}
+
+const PredicateOptimizer::Plan& PredicateOptimizer::plan(const Cube &cube, const cube_list &set)
+{
+	// set holds only the cubes that lie within cube, so cube alone is the key
+	map<Cube, Plan>::iterator found = plans.find(cube);
+	if (found != plans.end()) return found->second;
+	
+	++searched;
+	Plan best;
+	double weight = weights.of(cube.mask, cube.val);
+	
+	// every cube of the set is disjoint from the others, so the set fills
+	// cube exactly when their sizes add up to its size
+	double size = 0;
+	uint32_t shared = ~(uint32_t)0, differ = 0;
+	for (cube_list::const_iterator i = set.begin(), e = set.end(); i != e; ++i)
+	{
+		size += ldexp(1.0, 32 - __builtin_popcount(i->mask));
+		shared &= i->mask;
+		differ |= i->val ^ set.front().val;
+	}
+	uint32_t common = shared & ~differ & ~cube.mask;
+	
+	if (set.empty()) best.choice = NONE;
+	else if (size == ldexp(1.0, 32 - __builtin_popcount(cube.mask))) best.choice = ALL;
+	else if (set.size() == 1)
+	{
+		best.choice = SINGLE;
+		best.cost = weight;
+		best.bits = common;
+		best.val = set.front().val & common;
+	}
+	else
+	{
+		if (common != 0)
+		{
+			// all of the set agrees on these bits, so a single test of them
+			// narrows the cube down, like MatchTree::prune_base()
+			double cost = weight + plan(Cube(cube.mask | common, cube.val | (set.front().val & common)), set).cost;
+			best.choice = COMMON;
+			best.cost = cost;
+			best.bits = common;
+			best.val = set.front().val & common;
+		}
+		
+		// the highest free bit is the one MatchTree would split on. The other
+		// candidates are the bits that split the fewest cubes of the set in two
+		vector<pair<unsigned, uint32_t> > candidates;
+		uint32_t highest = 0;
+		for (uint32_t bit = (uint32_t)1 << 31; bit != 0; bit >>= 1)
+		{
+			if ((cube.mask | common) & bit) continue;
+			if (highest == 0) highest = bit;
+			else
+			{
+				unsigned split = 0;
+				for (cube_list::const_iterator i = set.begin(), e = set.end(); i != e; ++i) if (!(i->mask & bit)) ++split;
+				candidates.push_back(make_pair(split, ~bit));	// ~bit orders equal splits from the highest bit down
+			}
+		}
+		sort(candidates.begin(), candidates.end());
+		candidates.insert(candidates.begin(), make_pair(0u, ~highest));
+		
+		unsigned tries = plans.size() < width * max_cubes ? width : 1;
+		for (unsigned j = 0; j < tries && j < candidates.size(); ++j)
+		{
+			uint32_t bit = ~candidates[j].second;
+			Cube on(cube.mask | bit, cube.val | bit), off(cube.mask | bit, cube.val);
+			cube_list on_set, off_set;
+			restrict(set, on, on_set);
+			restrict(set, off, off_set);
+			
+			double cost = weight + plan(on, on_set).cost;
+			if (best.choice != NONE && cost >= best.cost) continue;
+			cost += plan(off, off_set).cost;
+			if (best.choice != NONE && cost >= best.cost) continue;
+			
+			best.choice = SPLIT;
+			best.cost = cost;
+			best.bits = bit;
+			best.val = 0;
+		}
+	}
+	
+	return plans[cube] = best;
+}
+
+int PredicateOptimizer::build(IPredicate &predicate, const Cube &cube, const cube_list &set)
+{
+	const Plan &p = plan(cube, set);
+	int compare_jump = 0;
+	IPredicate *q = 0;
+	
+	switch (p.choice)
+	{
+		case NONE:
+			q = new TerminalPredicate(false);
+			break;
+		case ALL:
+			q = new TerminalPredicate(true);
+			break;
+		case SINGLE:
+			q = new TerminalPredicate(true, (codevalue)p.bits, (codevalue)p.val);
+			compare_jump = 1;
+			break;
+		case COMMON:
+		{
+			AndPredicate *a = new AndPredicate(new TerminalPredicate(true, (codevalue)p.bits, (codevalue)p.val));
+			compare_jump = 1 + build(*a, Cube(cube.mask | p.bits, cube.val | p.val), set);
+			q = a;
+			break;
+		}
+		case SPLIT:
+		{
+			// the subtree where the bit is set is pushed first, as in MatchTree::create_predicate()
+			TernaryPredicate *t = new TernaryPredicate((codevalue)p.bits);
+			Cube on(cube.mask | p.bits, cube.val | p.bits), off(cube.mask | p.bits, cube.val);
+			cube_list on_set, off_set;
+			restrict(set, on, on_set);
+			restrict(set, off, off_set);
+			compare_jump = 1 + build(*t, on, on_set);
+			compare_jump += build(*t, off, off_set);
+			q = t;
+			break;
+		}
+	}
+	
+	push_predicate(predicate, q);
+	return compare_jump;
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include "range_list.hpp"
+#include "predicate.hpp"
+
+
+//----- CodevalueWeights ------------------------------------------------------
+
+// How often codevalues are expected to be classified, as a weight per single
+// codevalue in each of three areas. Parsed from "ascii:bmp:astral".
+struct CodevalueWeights
+{
+	CodevalueWeights() : ascii(1), bmp(1), astral(1) {}
+	
+	bool parse(const char * const spec);
+	
+	double of(uint32_t c) const { return c < 0x80 ? ascii : c < 0x10000 ? bmp : c <= (uint32_t)max_codevalue ? astral : 0; }
+	double of(uint32_t mask, uint32_t val) const;	// total weight of all c with (c & mask) == val
+	
+	double ascii, bmp, astral;
+};
+
+// The compare/jumps it takes predicate to classify a codevalue, on (weighted)
+// average and at most, measured by running its bytecode on every codevalue
+struct CompareProfile
+{
+	CompareProfile(Predicate &predicate, const CodevalueWeights &weights);
+	
+	double mean;
+	unsigned max;
+	unsigned nodes;		// number of predicate nodes
+};
+
+inline double expected_compares(Predicate &predicate, const CodevalueWeights &weights) { return CompareProfile(predicate, weights).mean; }
+
+
+//----- PredicateOptimizer ----------------------------------------------------
+
+// Builds a predicate with the least expected number of compare/jumps, by
+// dynamic programming over cubes, i.e. the sets of codevalues that match a
+// (mask, value) test. The set to classify is held as a list of disjoint cubes.
+// In every cube the optimizer either answers with a constant, tests a single
+// cube of the set, tests the bits shared by all of the set in one compare
+// (like MatchTree::prune_base), or splits the cube on one of its free bits.
+// Unlike MatchTree it may split on any bit, not only the highest one. The
+// effort bounds the search: every width from 1 to effort is searched, where
+// width is the number of split bits tried in each cube until the number of
+// cubes visited passes width * max_cubes, after which only the highest bit
+// is tried.
+struct PredicateOptimizer
+{
+	struct Cube
+	{
+		Cube(uint32_t mask = 0, uint32_t val = 0) : mask(mask), val(val & mask) {}
+		bool operator<(const Cube &c) const { return mask < c.mask || (mask == c.mask && val < c.val); }
+		uint32_t mask, val;
+	};
+	
+	typedef std::vector<Cube> cube_list;
+	
+	enum Choice { NONE, ALL, SINGLE, COMMON, SPLIT };
+	
+	struct Plan
+	{
+		Plan() : cost(0), choice(NONE), bits(0), val(0) {}
+		double cost;		// weight of the cube times its expected compare/jumps
+		Choice choice;
+		uint32_t bits, val;	// the bit to split on, or the bits (and their value) to test
+	};
+	
+	PredicateOptimizer(const range_list &ranges, const CodevalueWeights &weights, unsigned effort, unsigned bits = 32);	// bits as in MatchTree
+	
+	int create_predicate(IPredicate &predicate);
+	
+	const Plan& plan(const Cube &cube, const cube_list &set);
+	int build(IPredicate &predicate, const Cube &cube, const cube_list &set);
+	static void restrict(const cube_list &set, const Cube &cube, cube_list &result);
+	
+	static const unsigned max_cubes = 20000;
+	
+	const CodevalueWeights &weights;
+	unsigned effort, width;
+	unsigned searched;	// cubes planned in all widths
+	cube_list set;
+	Cube root;	// codevalues of bits bits, whose higher bits are known to be clear
+	std::map<Cube, Plan> plans;
+};
+
+#endif
@@ -3,8 +3,13 @@
 // Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
 
 #include <cassert>
+#include <memory>
+#include <algorithm>
+#include <stdint.h>
 #include "predicate.hpp"
 
+using namespace std;
+
 //----- Predicate -------------------------------------------------------------
 
 bool Predicate::push(IPredicate *p)
@@ -104,3 +109,110 @@ void TernaryPredicate::accept(IGenerator &generator)
 {
 	generator.visit(*this);
 }
+
+
+//----- TablePredicate --------------------------------------------------------
+
+void TablePredicate::set(codevalue first, codevalue last)
+{
+	for (uint32_t i = first - base, n = last - base; i <= n; ++i) bits[i >> 3] |= 1 << (i & 7);
+}
+
+void TablePredicate::accept(IGenerator &generator)
+{
+	generator.visit(*this);
+}
+
+
+//----- RangePredicate --------------------------------------------------------
+
+void RangePredicate::accept(IGenerator &generator)
+{
+	generator.visit(*this);
+}
+
+
+//----- HashPredicate ---------------------------------------------------------
+
+// Buckets are placed from the largest to the smallest, while the table still
+// has room for them, trying displacements until all the codevalues of a
+// bucket land in distinct free slots.
+struct BucketSizeGreater
+{
+	BucketSizeGreater(const vector<codevalue_vector> &buckets) : buckets(buckets) {}
+	bool operator()(uint32_t a, uint32_t b) const { return buckets[a].size() > buckets[b].size(); }
+	const vector<codevalue_vector> &buckets;
+};
+
+static bool place_buckets(HashPredicate &hash, const codevalue_vector &codes)
+{
+	vector<codevalue_vector> buckets(hash.displacements.size());
+	for (size_t i = 0, n = codes.size(); i < n; ++i) buckets[hash.bucket((uint32_t)codes[i])].push_back(codes[i]);
+	vector<uint32_t> order;
+	for (uint32_t b = 0, e = buckets.size(); b < e; ++b) if (!buckets[b].empty()) order.push_back(b);
+	stable_sort(order.begin(), order.end(), BucketSizeGreater(buckets));
+	
+	size_t size = hash.slots.size();
+	vector<bool> taken(size, false);
+	vector<uint32_t> s;
+	for (size_t i = 0, n = order.size(); i < n; ++i)
+	{
+		const codevalue_vector &bucket = buckets[order[i]];
+		uint32_t d = 0, last = HashPredicate::max_displacements * size;
+		for (; d < last; ++d)
+		{
+			s.clear();
+			size_t j = 0, k = bucket.size();
+			for (; j < k; ++j)
+			{
+				uint32_t slot = hash.slot((uint32_t)bucket[j], d);
+				if (taken[slot] || find(s.begin(), s.end(), slot) != s.end()) break;
+				s.push_back(slot);
+			}
+			if (j == k) break;
+		}
+		if (d == last) return false;
+		
+		hash.displacements[order[i]] = d;
+		for (size_t j = 0, k = bucket.size(); j < k; ++j)
+		{
+			taken[s[j]] = true;
+			hash.slots[s[j]] = (uint32_t)bucket[j];
+		}
+	}
+	
+	// a codevalue never hashes to a slot other than its own, so it is a safe filler
+	for (size_t j = 0; j < size; ++j) if (!taken[j]) hash.slots[j] = (uint32_t)codes[0];
+	return true;
+}
+
+HashPredicate* HashPredicate::build(const range_list &ranges)
+{
+	auto_ptr<codevalue_vector> codes(to_codevalues(ranges));
+	size_t n = codes->size();
+	if (n < 2 || n > ((size_t)1 << max_bits)) return 0;
+	
+	unsigned bits = 1;
+	while (((size_t)bucket_size << bits) < n) ++bits;
+	
+	// the minimal size is tried first, and the multipliers are drawn from a
+	// fixed sequence, so the hash is the same on every run
+	uint32_t seed = 0x9E3779B9;
+	size_t step = n / 16 + 1;
+	for (size_t size = n, last = n + extra_sizes * step; size <= last; size += step)
+	{
+		for (unsigned t = 0; t < max_tries; ++t)
+		{
+			seed = seed * 1664525 + 1013904223;
+			auto_ptr<HashPredicate> hash(new HashPredicate(seed | 1, 32 - bits, size));
+			hash->count = n;
+			if (place_buckets(*hash, *codes)) return hash.release();
+		}
+	}
+	return 0;
+}
+
+void HashPredicate::accept(IGenerator &generator)
+{
+	generator.visit(*this);
+}
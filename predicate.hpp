@@ -5,7 +5,11 @@
 #ifndef PREDICATE_H
 #define PREDICATE_H
 
+#include <vector>
+#include <cassert>
+#include <stdint.h>
 #include "codevalue.hpp"
+#include "range_list.hpp"
 
 struct IPredicate;
 struct Predicate;
@@ -13,15 +17,28 @@ struct TerminalPredicate;
 struct AndPredicate;
 struct OrPredicate;
 struct TernaryPredicate;
+struct TablePredicate;
+struct RangePredicate;
+struct HashPredicate;
 
 #include "generator.hpp"
 
 
 struct IPredicate : public IGeneratable
 {
+	virtual ~IPredicate() {}
 	virtual bool push(IPredicate *p) = 0;
 };
 
+// pushes p into predicate, where it must find a place; the push is made even
+// when assertions are compiled out
+inline void push_predicate(IPredicate &predicate, IPredicate *p)
+{
+	bool pushed = predicate.push(p);
+	assert(pushed);
+	(void)pushed;
+}
+
 
 struct Predicate : public IPredicate
 {
@@ -92,4 +109,70 @@ struct TernaryPredicate : public IPredicate
 	IPredicate *predicate, *on, *off;
 };
 
+
+// Matches c if it falls within the aligned block of size codevalues starting
+// at base, and its bit in the block's bitmap is set. A table replaces a whole
+// subtree of compare/jumps with a single lookup, which is smaller when the
+// subtree is dense and irregular.
+struct TablePredicate : public IPredicate
+{
+	TablePredicate(codevalue base, codevalue size) : base(base), size(size), bits((size + 31) / 32 * 4, 0) {}
+	
+	virtual bool push(IPredicate *p) { return false; }
+	virtual void accept(IGenerator &generator);
+	
+	void set(codevalue first, codevalue last);	// sets the bits of first..last, which must lie within the block
+	
+	codevalue base, size;
+	std::vector<unsigned char> bits;	// bit (c-base)%8 of byte (c-base)/8, padded to whole 32-bit words
+};
+
+// Matches c if it falls within the size codevalues starting at first, with a
+// single unsigned compare: (unsigned)(c - first) < size. A range that is not
+// an aligned block would otherwise take several mask/value tests.
+struct RangePredicate : public IPredicate
+{
+	RangePredicate(codevalue first, codevalue size) : first(first), size(size) {}
+	
+	virtual bool push(IPredicate *p) { return false; }
+	virtual void accept(IGenerator &generator);
+	
+	codevalue first, size;
+};
+
+
+// Matches c if it is one of a small and sparse set of codevalues, using a
+// minimal perfect hash with displacements (CHD): the multiply-shift
+// (c * multiplier) >> shift picks a bucket of a few codevalues, and the
+// displacement of the bucket is mixed into c to give each of them a slot of
+// its own, so c matches if it equals the codevalue in its slot. There are
+// as many slots as codevalues, unless no displacements were found for that
+// size, in which case a few empty slots hold a codevalue of another slot.
+struct HashPredicate : public IPredicate
+{
+	HashPredicate(uint32_t multiplier, unsigned shift, size_t size) : multiplier(multiplier), shift(shift), count(size), displacements((size_t)1 << (32 - shift), 0), slots(size, 0) {}
+	
+	static HashPredicate* build(const range_list &ranges);	// 0 if no perfect hash was found
+	
+	virtual bool push(IPredicate *p) { return false; }
+	virtual void accept(IGenerator &generator);
+	
+	uint32_t bucket(uint32_t c) const { return (c * multiplier) >> shift; }
+	uint32_t slot(uint32_t c, uint32_t displacement) const { return (uint32_t)((uint64_t)((c ^ displacement) * multiplier) * slots.size() >> 32); }
+	uint32_t slot(uint32_t c) const { return slot(c, displacements[bucket(c)]); }
+	double load_factor() const { return slots.empty() ? 0 : (double)count / slots.size(); }
+	
+	static const unsigned bucket_size = 4;		// average codevalues in a bucket
+	static const unsigned extra_sizes = 4;		// sizes tried beyond the minimal one, each 1/16 larger
+	static const unsigned max_tries = 16;		// multipliers tried for each size
+	static const unsigned max_displacements = 16;	// displacements tried for each bucket, times the size
+	static const unsigned max_bits = 16;
+	static const int compare_jumps = 3;			// two multiplies and two dependent loads cost about as much as three compare/jumps
+	
+	uint32_t multiplier;
+	unsigned shift;
+	size_t count;	// codevalues in the set
+	std::vector<uint32_t> displacements, slots;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,121 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include <algorithm>
+#include <memory>
+#include <stdint.h>
+#include "range_list.hpp"
+
+using namespace std;
+
+
+//----- Conversions -----------------------------------------------------------
+
+range_list* to_ranges(const codevalue_vector &codes)
+{
+	auto_ptr<range_list> ranges(new range_list);
+	for (codevalue_vector::const_iterator i = codes.begin(), e = codes.end(); i != e; ++i)
+	{
+		if (!ranges->empty() && *i <= ranges->back().second + 1)
+		{
+			if (*i > ranges->back().second) ranges->back().second = *i;
+		}
+		else ranges->push_back(coderange(*i, *i));
+	}
+	return ranges.release();
+}
+
+codevalue_vector* to_codevalues(const range_list &ranges)
+{
+	auto_ptr<codevalue_vector> codes(new codevalue_vector);
+	for (range_list::const_iterator i = ranges.begin(), e = ranges.end(); i != e; ++i)
+		for (codevalue c = i->first; c <= i->second; ++c) codes->push_back(c);
+	return codes.release();
+}
+
+unsigned range_count(const range_list &ranges)
+{
+	unsigned n = 0;
+	for (range_list::const_iterator i = ranges.begin(), e = ranges.end(); i != e; ++i) n += i->second - i->first + 1;
+	return n;
+}
+
+range_list* normalize(range_list &ranges)
+{
+	sort(ranges.begin(), ranges.end());
+	auto_ptr<range_list> merged(new range_list);
+	for (range_list::const_iterator i = ranges.begin(), e = ranges.end(); i != e; ++i)
+	{
+		if (!merged->empty() && i->first <= merged->back().second + 1)
+		{
+			if (i->second > merged->back().second) merged->back().second = i->second;
+		}
+		else merged->push_back(*i);
+	}
+	return merged.release();
+}
+
+
+//----- Set operations --------------------------------------------------------
+
+range_list* range_union(const range_list &a, const range_list &b)
+{
+	range_list all;
+	all.reserve(a.size() + b.size());
+	merge(a.begin(), a.end(), b.begin(), b.end(), back_inserter(all));
+	return normalize(all);
+}
+
+range_list* range_intersection(const range_list &a, const range_list &b)
+{
+	auto_ptr<range_list> ranges(new range_list);
+	range_list::const_iterator i = a.begin(), j = b.begin();
+	while (i != a.end() && j != b.end())
+	{
+		codevalue first = max(i->first, j->first), last = min(i->second, j->second);
+		if (first <= last) ranges->push_back(coderange(first, last));
+		if (i->second < j->second) ++i; else ++j;	// advance whichever ends first
+	}
+	return ranges.release();
+}
+
+range_list* range_difference(const range_list &a, const range_list &b)
+{
+	auto_ptr<range_list> not_b(range_complement(b));
+	return range_intersection(a, *not_b);
+}
+
+range_list* range_complement(const range_list &a)
+{
+	auto_ptr<range_list> ranges(new range_list);
+	codevalue next = 0;
+	for (range_list::const_iterator i = a.begin(), e = a.end(); i != e; ++i)
+	{
+		if (i->first > next) ranges->push_back(coderange(next, i->first - 1));
+		next = i->second + 1;
+	}
+	if (next <= max_codevalue) ranges->push_back(coderange(next, max_codevalue));
+	return ranges.release();
+}
+
+range_list* range_cover(const range_list &a, const range_list &dont_care)
+{
+	// every range is split into its largest aligned blocks, as in MatchTree::add()
+	auto_ptr<range_list> all(range_union(a, dont_care));
+	range_list blocks;
+	range_list::const_iterator j = a.begin();
+	for (range_list::const_iterator i = all->begin(), e = all->end(); i != e; ++i)
+	{
+		uint32_t first = i->first, last = i->second;
+		while (first <= last)
+		{
+			uint32_t size = 1;
+			while (first % (size << 1) == 0 && first + (size << 1) - 1 <= last) size <<= 1;
+			while (j != a.end() && (uint32_t)j->second < first) ++j;
+			if (j != a.end() && (uint32_t)j->first <= first + size - 1) blocks.push_back(coderange(first, first + size - 1));
+			first += size;
+		}
+	}
+	return normalize(blocks);
+}
@@ -0,0 +1,38 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef RANGE_LIST_H
+#define RANGE_LIST_H
+
+#include <utility>
+#include <vector>
+#include "codevalue.hpp"
+
+
+//----- range_list ------------------------------------------------------------
+
+typedef std::pair<codevalue, codevalue> coderange;	// first..last, both inclusive
+
+// Sorted ranges that neither overlap nor touch each other, so that every set
+// of codevalues has exactly one range_list.
+typedef std::vector<coderange> range_list;
+
+static const codevalue max_codevalue = 0x10FFFF;
+
+range_list* to_ranges(const codevalue_vector &codes);	// codes should be sorted
+codevalue_vector* to_codevalues(const range_list &ranges);
+unsigned range_count(const range_list &ranges);			// number of codevalues in ranges
+range_list* normalize(range_list &ranges);				// sorts and merges arbitrary ranges
+
+range_list* range_union(const range_list &a, const range_list &b);
+range_list* range_intersection(const range_list &a, const range_list &b);
+range_list* range_difference(const range_list &a, const range_list &b);
+range_list* range_complement(const range_list &a);		// within 0..max_codevalue
+
+// the union of the largest aligned blocks of codevalues within a and dont_care
+// together that hold any of a, i.e. a grown into dont_care wherever this
+// merges it into larger blocks, which take fewer match tree nodes
+range_list* range_cover(const range_list &a, const range_list &dont_care);
+
+#endif
@@ -0,0 +1,47 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include <memory>
+#include "runtime_classifier.hpp"
+#include "match_tree.hpp"
+#include "set_expression.hpp"
+
+using namespace std;
+
+
+//----- RuntimeClassifier -----------------------------------------------------
+
+RuntimeClassifier* RuntimeClassifier::build(const char * const categories, UnicodeData &data)
+{
+	auto_ptr<range_list> ranges(SetExpression(data).evaluate(categories));
+	if (ranges.get() == 0) return 0;
+	return build(*ranges);
+}
+
+RuntimeClassifier* RuntimeClassifier::build(const range_list &ranges)
+{
+	MatchTree tree(ranges);
+	Predicate predicate;
+	tree.create_predicate(predicate);
+	return build(predicate);
+}
+
+RuntimeClassifier* RuntimeClassifier::build(codevalue_vector &codes)
+{
+	MatchTree tree(codes);
+	Predicate predicate;
+	tree.create_predicate(predicate);
+	return build(predicate);
+}
+
+RuntimeClassifier* RuntimeClassifier::build(Predicate &predicate)
+{
+	BytecodeCompiler compiler;
+	compiler.generate("", predicate);
+
+	RuntimeClassifier *classifier = new RuntimeClassifier;
+	classifier->code.swap(compiler.code);
+	classifier->entry = compiler.entry;
+	return classifier;
+}
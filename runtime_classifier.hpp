@@ -0,0 +1,46 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef RUNTIME_CLASSIFIER_H
+#define RUNTIME_CLASSIFIER_H
+
+#include "codevalue.hpp"
+#include "unicode_data.hpp"
+#include "predicate.hpp"
+#include "bytecode.hpp"
+
+
+//----- RuntimeClassifier -----------------------------------------------------
+
+// A classifier that is built and evaluated in-process, without generating and
+// compiling code. It goes through the same UnicodeData -> MatchTree -> Predicate
+// pipeline as the generator, and lowers the resulting predicate to bytecode:
+//
+//		UnicodeData data("UnicodeData.txt");
+//		std::auto_ptr<RuntimeClassifier> letter(RuntimeClassifier::build("Lu,Ll", data));
+//		if ((*letter)(c)) ...
+//
+struct RuntimeClassifier
+{
+	static RuntimeClassifier* build(const char * const categories, UnicodeData &data);	// categories is a set expression, 0 on a syntax error
+	static RuntimeClassifier* build(const range_list &ranges);
+	static RuntimeClassifier* build(codevalue_vector &codes);
+	static RuntimeClassifier* build(Predicate &predicate);
+
+	bool operator()(codevalue c) const
+	{
+		uint32_t pc = entry, x = (uint32_t)c;
+		while (pc < BC_REJECT)
+		{
+			const bc_instruction &i = code[pc];
+			pc = bc_match(&i, x) ? i.match : i.miss;
+		}
+		return pc == BC_ACCEPT;
+	}
+
+	bc_program code;
+	uint32_t entry;
+};
+
+#endif
@@ -0,0 +1,240 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include <cctype>
+#include <memory>
+#include <sstream>
+#include <map>
+#include "set_expression.hpp"
+
+using namespace std;
+
+
+//----- SetExpression ---------------------------------------------------------
+
+range_list* SetExpression::evaluate(const string &s)
+{
+	spec = s;
+	pos = 0;
+	auto_ptr<range_list> ranges(parse_union());
+	if (ranges.get() != 0 && pos < spec.size()) return error("Unexpected character");
+	return ranges.release();
+}
+
+void SetExpression::skip_whitespace()
+{
+	while (pos < spec.size() && isspace(spec[pos])) ++pos;
+}
+
+bool SetExpression::skip(char c)	// skips whitespace, and then c if it is next
+{
+	skip_whitespace();
+	if (pos == spec.size() || spec[pos] != c) return false;
+	++pos;
+	return true;
+}
+
+range_list* SetExpression::error(const char * const message)
+{
+	cerr << "Error: " << message << " at position " << pos+1 << " of '" << spec << "'." << endl;
+	return 0;
+}
+
+range_list* SetExpression::parse_union()
+{
+	auto_ptr<range_list> lhs(parse_intersection());
+	while (lhs.get() != 0)
+	{
+		bool difference;
+		if (skip('|') || skip(',')) difference = false;
+		else if (skip('-')) difference = true;
+		else break;
+		
+		auto_ptr<range_list> rhs(parse_intersection());
+		if (rhs.get() == 0) return 0;
+		lhs.reset(difference ? range_difference(*lhs, *rhs) : range_union(*lhs, *rhs));
+	}
+	return lhs.release();
+}
+
+range_list* SetExpression::parse_intersection()
+{
+	auto_ptr<range_list> lhs(parse_primary());
+	while (lhs.get() != 0 && skip('&'))
+	{
+		auto_ptr<range_list> rhs(parse_primary());
+		if (rhs.get() == 0) return 0;
+		lhs.reset(range_intersection(*lhs, *rhs));
+	}
+	return lhs.release();
+}
+
+range_list* SetExpression::parse_primary()
+{
+	if (skip('!'))
+	{
+		auto_ptr<range_list> operand(parse_primary());
+		return operand.get() == 0 ? 0 : range_complement(*operand);
+	}
+	
+	if (skip('('))
+	{
+		auto_ptr<range_list> inner(parse_union());
+		if (inner.get() != 0 && !skip(')')) return error("Missing ')'");
+		return inner.release();
+	}
+	
+	if (skip('['))
+	{
+		auto_ptr<range_list> items(new range_list);
+		while (!skip(']'))
+		{
+			if (pos == spec.size()) return error("Missing ']'");
+			auto_ptr<range_list> item(parse_union());
+			if (item.get() == 0) return 0;
+			items.reset(range_union(*items, *item));
+		}
+		return items.release();
+	}
+	
+	skip_whitespace();
+	size_t start = pos;
+	while (pos < spec.size() && (isalnum(spec[pos]) || spec[pos] == '_')) ++pos;
+	if (pos == start) return error("Expected a set");
+	string name = spec.substr(start, pos - start);
+	
+	if (name == "U" && pos < spec.size() && spec[pos] == '+')
+	{
+		auto_ptr<range_list> ranges(new range_list);
+		codevalue first, last;
+		if (!parse_codevalue(first)) return 0;
+		last = first;
+		if (pos + 1 < spec.size() && spec.compare(pos, 2, "..") == 0)
+		{
+			pos += 2;
+			if (!skip('U') || !parse_codevalue(last)) return error("Expected U+XXXX after '..'");
+			if (last < first) return error("Reversed range");
+		}
+		ranges->push_back(coderange(first, last));
+		return ranges.release();
+	}
+	
+	return parse_set(name);
+}
+
+bool SetExpression::parse_codevalue(codevalue &c)	// parses +XXXX after a U
+{
+	if (pos == spec.size() || spec[pos] != '+') return false;
+	size_t start = ++pos;
+	unsigned long value = 0;
+	while (pos < spec.size() && isxdigit(spec[pos]) && pos - start < 6)
+		value = value * 16 + (isdigit(spec[pos]) ? spec[pos] - '0' : toupper(spec[pos]) - 'A' + 10), ++pos;
+	if (pos == start || value > (unsigned long)max_codevalue)
+	{
+		error("Expected a codevalue up to U+10FFFF");
+		return false;
+	}
+	c = (codevalue)value;
+	return true;
+}
+
+range_list* SetExpression::parse_set(const string &name)
+{
+	if (name == "Any")
+	{
+		range_list none;
+		return range_complement(none);
+	}
+	
+	if (name == "Assigned" || name == "Cn")
+	{
+		auto_ptr<range_list> assigned(data.filter(0, 0));	// a zero mask matches every listed codevalue
+		return name == "Cn" ? range_complement(*assigned) : assigned.release();
+	}
+	
+	if (name == "ASCII")
+	{
+		auto_ptr<range_list> ranges(new range_list(1, coderange(0, 0x7F)));
+		return ranges.release();
+	}
+	
+	if (name == "LC")
+	{
+		auto_ptr<range_list> lu(parse_set("Lu")), ll(parse_set("Ll")), lt(parse_set("Lt"));
+		auto_ptr<range_list> cased(range_union(*lu, *ll));
+		return range_union(*cased, *lt);
+	}
+	
+	map<string, range_list>::const_iterator property = data.property_values.find(name);
+	if (property != data.property_values.end()) return new range_list(property->second);
+	
+	wstringstream wname;
+	wname << name.c_str();
+	if (name.size() == 1 && data.gc_map.find(wname.str()) == data.gc_map.end())
+	{
+		// a major class is the union of all the general categories that start with its letter
+		auto_ptr<range_list> ranges(new range_list);
+		if (name == "C")
+		{
+			auto_ptr<range_list> cn(parse_set("Cn"));
+			ranges.reset(cn.release());
+		}
+		for (map<wstring, UnicodeData::property_t>::const_iterator i = data.gc_map.begin(), e = data.gc_map.end(); i != e; ++i)
+		{
+			if (i->first.size() != 2 || i->first[0] != wname.str()[0] || i->second == 0) continue;
+			auto_ptr<range_list> more(data.filter(UnicodeData::gc_mask, data.propval(UnicodeData::gc_mask, UnicodeData::gc_shift, i->second)));
+			ranges.reset(range_union(*ranges, *more));
+		}
+		if (ranges->empty()) cerr << "Error: Major class '" << name << "' is undefined. Ignoring." << endl;
+		return ranges.release();
+	}
+	
+	return data.filter_gc(name.c_str());	// reports undefined categories
+}
+
+string SetExpression::identifier(const string &spec)
+{
+	// commas keep mapping to a single underscore, so union specs keep their names
+	string id;
+	for (string::const_iterator i = spec.begin(), e = spec.end(); i != e; ++i)
+	{
+		switch (*i)
+		{
+			case '&': id += "_and_"; break;
+			case '|': id += "_or_"; break;
+			case '-': id += "_minus_"; break;
+			case '!': id += "_not_"; break;
+			case '+': break;
+			case '.': if (i + 1 != e && i[1] == '.') { id += "_to_"; ++i; } else id += '_'; break;
+			default: id += isalnum(*i) ? *i : '_'; break;
+		}
+	}
+	
+	// collapse repeated underscores, and drop them at both ends
+	string collapsed;
+	for (string::const_iterator i = id.begin(), e = id.end(); i != e; ++i)
+		if (*i != '_' || (!collapsed.empty() && collapsed[collapsed.size()-1] != '_')) collapsed += *i;
+	while (!collapsed.empty() && collapsed[collapsed.size()-1] == '_') collapsed.erase(collapsed.size()-1);
+	return collapsed;
+}
+
+bool SetExpression::identifiers(const vector<string> &specs, vector<string> &names)
+{
+	// specs that differ only in punctuation, like (Lu) and Lu or [Zs Zl] and
+	// Zs,Zl, have the same identifier, and so would write the same files
+	map<string, size_t> first;
+	names.clear();
+	for (size_t i = 0; i < specs.size(); ++i)
+	{
+		names.push_back(identifier(specs[i]));
+		map<string, size_t>::const_iterator j = first.find(names.back());
+		if (j != first.end())
+		{
+			cerr << "Error: Category specs '" << specs[j->second] << "' and '" << specs[i] << "' both generate the classifier uniclasser_" << names.back() << "." << endl;
+			return false;
+		}
+		first[names.back()] = i;
+	}
+	return true;
+}
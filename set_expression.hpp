@@ -0,0 +1,51 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef SET_EXPRESSION_H
+#define SET_EXPRESSION_H
+
+#include <string>
+#include <vector>
+#include "range_list.hpp"
+#include "unicode_data.hpp"
+
+
+//----- SetExpression ---------------------------------------------------------
+
+// Evaluates a classifier spec, which is a set expression over range lists:
+//
+//		union:			a|b  or  a,b
+//		intersection:	a&b				(binds tighter than union and difference)
+//		difference:		a-b
+//		complement:		!a
+//		grouping:		(a)  or  [a b c], which is the union of its items
+//		codevalues:		U+0370  or  U+0370..U+03FF
+//		sets:			a general category (Lu), a major class (L), LC, Cn,
+//						ASCII, Assigned, Any, or a value of a property file
+//						(Latin, White_Space, XID_Start)
+//
+// For example L&!Lo, Lu|U+0370..U+03FF, Nd-ASCII or [Zs Zl Zp].
+struct SetExpression
+{
+	SetExpression(UnicodeData &data) : data(data) {}
+
+	range_list* evaluate(const std::string &spec);	// returns 0 on a syntax error
+	static std::string identifier(const std::string &spec);	// a C identifier for spec
+	static bool identifiers(const std::vector<std::string> &specs, std::vector<std::string> &names);	// false if two specs have the same one
+
+	range_list* parse_union();
+	range_list* parse_intersection();
+	range_list* parse_primary();
+	range_list* parse_set(const std::string &name);
+	bool parse_codevalue(codevalue &c);
+	void skip_whitespace();
+	bool skip(char c);
+	range_list* error(const char * const message);
+
+	UnicodeData &data;
+	std::string spec;
+	size_t pos;
+};
+
+#endif
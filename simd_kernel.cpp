@@ -0,0 +1,53 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include <map>
+#include "simd_kernel.hpp"
+
+using namespace std;
+
+
+//----- SimdKernel ------------------------------------------------------------
+
+typedef vector<bool> byte_set;
+
+static void add_table(vector<unsigned char> &tables, const byte_set &set)
+{
+	size_t t = tables.size();
+	tables.resize(t + SimdKernel::table_size, 0);
+	for (unsigned x = 0; x < 256; ++x)
+		if (set[x]) tables[t + (x >> 7) * 16 + (x & 15)] |= 1 << ((x >> 4) & 7);
+}
+
+SimdKernel::SimdKernel(const range_list &bmp) : mixed(0), others(0)
+{
+	vector<byte_set> blocks(256, byte_set(256, false));
+	for (range_list::const_iterator i = bmp.begin(), e = bmp.end(); i != e; ++i)
+		for (uint32_t c = i->first; c <= (uint32_t)i->second && c <= 0xFFFF; ++c) blocks[c >> 8][c & 0xFF] = true;
+	
+	// at most 248 blocks are mixed, so their ids fit in a byte
+	map<byte_set, unsigned char> ids;
+	this->blocks.assign(256, (unsigned char)empty_block);
+	for (unsigned b = 0; b < 256; ++b)
+	{
+		unsigned n = 0;
+		for (unsigned x = 0; x < 256; ++x) n += blocks[b][x];
+		
+		unsigned char &id = this->blocks[b];
+		if (b >= 0xD8 && b <= 0xDF) id = other_block;	// surrogates
+		else if (n == 256) id = full_block;
+		else if (n > 0)
+		{
+			map<byte_set, unsigned char>::iterator i = ids.find(blocks[b]);
+			if (i == ids.end())
+			{
+				i = ids.insert(make_pair(blocks[b], (unsigned char)(first_mixed + ids.size()))).first;
+				add_table(tables, blocks[b]);
+			}
+			id = i->second;
+		}
+		others += id == other_block;
+	}
+	mixed = ids.size();
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef SIMD_KERNEL_H
+#define SIMD_KERNEL_H
+
+#include <vector>
+#include "codevalue.hpp"
+#include "range_list.hpp"
+
+
+//----- SimdKernel ------------------------------------------------------------
+
+// The lookup tables of a vectorized BMP classifier, which classifies 16 (or
+// 32) UTF-16 code units at once. The high byte of every code unit picks its
+// block of 256 codevalues, and the id of the block is looked up in blocks,
+// 16 ids per pshufb. A block is either empty, full, a surrogate block, which
+// the scalar code handles, or a mixed block, whose id is first_mixed plus
+// the index of its set of low bytes in tables. Every distinct mixed block has
+// an id, so a chunk goes to the scalar code only if it holds a surrogate.
+// A code unit of a mixed block matches if its low byte is in the set of the
+// block, which is looked up once for every distinct mixed block in a chunk:
+// once or twice in text of a single script.
+//
+// Every set of bytes is held as a nibble table of 32 bytes, for pshufb: byte
+// x is in the set if bit (x >> 4) & 7 of entry (x >> 7) * 16 + (x & 15) is
+// set.
+struct SimdKernel
+{
+	SimdKernel(const range_list &bmp);
+	
+	std::vector<unsigned char> blocks;	// the id of every block
+	std::vector<unsigned char> tables;	// the set of low bytes of every mixed block
+	unsigned mixed;		// number of distinct mixed blocks held in tables
+	unsigned others;	// number of blocks left to the scalar code, which are the 8 surrogate blocks
+	
+	static const unsigned char empty_block = 0, full_block = 1, other_block = 2, first_mixed = 3;
+	static const unsigned table_size = 32;
+};
+
+#endif
@@ -0,0 +1,218 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "codevalue.hpp"
+#include "stats.hpp"
+
+using namespace std;
+
+
+//----- Clocks ----------------------------------------------------------------
+
+double wall_clock()
+{
+	timeval t;
+	gettimeofday(&t, 0);
+	return t.tv_sec * 1e6 + t.tv_usec;
+}
+
+double cpu_clock(long *peak_rss)
+{
+	rusage u;
+	if (peak_rss != 0)
+	{
+		getrusage(RUSAGE_SELF, &u);
+		*peak_rss = u.ru_maxrss;
+	}
+#ifdef RUSAGE_THREAD
+	getrusage(RUSAGE_THREAD, &u);
+#else
+	getrusage(RUSAGE_SELF, &u);	// the whole process, which overlaps the stages of other threads (-j)
+#endif
+	return (u.ru_utime.tv_sec + u.ru_stime.tv_sec) * 1e6 + u.ru_utime.tv_usec + u.ru_stime.tv_usec;
+}
+
+
+//----- Stats -----------------------------------------------------------------
+
+__thread unsigned long Stats::allocations = 0;
+
+Stats::Stats() : enabled(false), thread(0), origin(wall_clock()), cpu_start(0), allocations_start(0), running(false)
+{
+}
+
+void Stats::begin(const char *name, const string &classifier)
+{
+	if (!enabled) return;
+	if (running) end();
+
+	Stage s;
+	s.name = name;
+	s.classifier = classifier;
+	s.thread = thread;
+	s.start = wall_clock() - origin;
+	s.wall = s.cpu = 0;
+	s.peak_rss = 0;
+	s.allocations = 0;
+	stages.push_back(s);
+
+	cpu_start = cpu_clock();
+	allocations_start = allocations;
+	running = true;
+}
+
+void Stats::end()
+{
+	if (!running) return;
+	running = false;
+
+	Stage &s = stages.back();
+	s.allocations = allocations - allocations_start;
+	s.cpu = cpu_clock(&s.peak_rss) - cpu_start;
+	s.wall = wall_clock() - origin - s.start;
+}
+
+void Stats::merge(const Stats &other)
+{
+	// the stages are moved to the timeline of this Stats
+	for (vector<Stage>::const_iterator i = other.stages.begin(); i != other.stages.end(); ++i)
+	{
+		stages.push_back(*i);
+		stages.back().start += other.origin - origin;
+	}
+}
+
+double Stats::wall(const string &classifier) const
+{
+	double total = 0;
+	for (vector<Stage>::const_iterator i = stages.begin(); i != stages.end(); ++i)
+		if (i->classifier == classifier) total += i->wall;
+	return total;
+}
+
+void Stats::report(ostream &out) const
+{
+	out << dec << fixed << setprecision(2) << left
+		<< setw(10) << "stage" << setw(32) << "classifier" << right
+		<< setw(12) << "wall ms" << setw(12) << "cpu ms" << setw(14) << "peak rss kb" << setw(14) << "allocations" << endl;
+
+	map<string, Stage> totals;
+	vector<string> order;
+	for (vector<Stage>::const_iterator i = stages.begin(); i != stages.end(); ++i)
+	{
+		out << left << setw(10) << i->name << setw(32) << i->classifier << right
+			<< setw(12) << i->wall / 1000 << setw(12) << i->cpu / 1000 << setw(14) << i->peak_rss << setw(14) << i->allocations << endl;
+
+		if (i->classifier.empty()) continue;
+		if (totals.find(i->classifier) == totals.end())
+		{
+			order.push_back(i->classifier);
+			Stage &t = totals[i->classifier];
+			t = *i;
+			t.name = "total";
+		}
+		else
+		{
+			Stage &t = totals[i->classifier];
+			t.wall += i->wall;
+			t.cpu += i->cpu;
+			t.peak_rss = max(t.peak_rss, i->peak_rss);
+			t.allocations += i->allocations;
+		}
+	}
+
+	for (vector<string>::iterator i = order.begin(); i != order.end(); ++i)
+	{
+		Stage &t = totals[*i];
+		out << left << setw(10) << t.name << setw(32) << t.classifier << right
+			<< setw(12) << t.wall / 1000 << setw(12) << t.cpu / 1000 << setw(14) << t.peak_rss << setw(14) << t.allocations << endl;
+	}
+	out.unsetf(ios_base::floatfield | ios_base::adjustfield);
+	out << setprecision(6);
+}
+
+bool Stats::write_trace(string filename) const
+{
+	ofstream out(filename.c_str());
+	if (!out) return false;
+
+	// complete ("X") events, one per stage, with the classifier as the category
+	out << fixed << setprecision(0) << "{\"traceEvents\":[" << endl;
+	for (vector<Stage>::const_iterator i = stages.begin(); i != stages.end(); ++i)
+	{
+		out << (i == stages.begin() ? "" : ",\n") << "{\"name\":";
+		write_json_string(out, i->name);
+		out << ",\"cat\":";
+		write_json_string(out, i->classifier.empty() ? string("uniclasser") : i->classifier);
+		out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << i->thread + 1 << ",\"ts\":" << i->start << ",\"dur\":" << i->wall
+			<< ",\"args\":{\"cpu_us\":" << i->cpu << ",\"peak_rss_kb\":" << i->peak_rss << ",\"allocations\":" << i->allocations << "}}";
+	}
+	out << endl << "],\"displayTimeUnit\":\"ms\"}" << endl;
+	return out.good();
+}
+
+
+//----- Report ----------------------------------------------------------------
+
+bool Report::write(string filename) const
+{
+	ofstream out(filename.c_str());
+	if (!out) return false;
+	
+	out << "{" << endl << "\t\"generator\": ";
+	write_json_string(out, VERSION);
+	out << "," << endl << "\t\"unicode_data\": ";
+	write_json_string(out, data_filename);
+	out << "," << endl << "\t\"options\": ";
+	write_json_string(out, options);
+	out << "," << endl << "\t\"classifiers\": [";
+	
+	out << fixed;
+	for (vector<Classifier>::const_iterator i = classifiers.begin(); i != classifiers.end(); ++i)
+	{
+		out << (i == classifiers.begin() ? "" : ",") << endl << "\t\t{ \"spec\": ";
+		write_json_string(out, i->spec);
+		out << ", \"name\": ";
+		write_json_string(out, i->name);
+		out << "," << endl
+			<< "\t\t  \"codevalues\": " << i->codevalues << ", \"ranges\": " << i->ranges
+			<< ", \"tree_nodes\": " << i->tree_nodes << ", \"predicate_nodes\": " << i->predicate_nodes << "," << endl
+			<< "\t\t  \"compare_jumps\": " << i->compare_jumps << ", \"max_compares\": " << i->max_compares
+			<< ", \"mean_compares\": " << setprecision(4) << i->mean_compares << "," << endl
+			<< "\t\t  \"estimated_size\": " << i->estimated_size << ", \"code_size\": " << i->code_size
+			<< ", \"milliseconds\": " << setprecision(3) << i->milliseconds << " }";
+	}
+	out << endl << "\t]" << endl << "}" << endl;
+	return out.good();
+}
+
+
+//----- JSON ------------------------------------------------------------------
+
+void write_json_string(ostream &out, const string &s)
+{
+	out << '"';
+	for (string::const_iterator i = s.begin(); i != s.end(); ++i)
+	{
+		unsigned char c = *i;
+		if (c == '"' || c == '\\') out << '\\' << c;
+		else if (c < 0x20)
+		{
+			char buf[8];
+			sprintf(buf, "\\u%04x", c);
+			out << buf;
+		}
+		else out << c;
+	}
+	out << '"';
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+
+//----- Clocks ----------------------------------------------------------------
+
+double wall_clock();	// microseconds
+double cpu_clock(long *peak_rss = 0);	// microseconds of user and system time of the calling thread, and peak RSS in kilobytes
+
+
+//----- Stats -----------------------------------------------------------------
+
+// Wall time, CPU time, peak RSS and allocations of every stage of the
+// generator (parse, filter, tree, predicate, emit and finalize), per
+// classifier. Stages are timed between begin() and end(), and do not nest:
+//
+//		stats.begin("tree", classer_name);
+//		MatchTree tree(*ranges);
+//		stats.end();
+//
+// A Stats times the stages of a single thread, so every thread that builds
+// classifiers (-j) keeps its own, which are merged when it is done. CPU time
+// and allocations are those of the thread as well. A thread that waits for
+// helper threads adds their allocations to its own count.
+//
+// Allocations are counted by a replacement of the global operator new in
+// main.cpp, so only the generator counts them, and the benchmark and programs
+// linking the runtime library see none.
+struct Stats
+{
+	struct Stage
+	{
+		std::string name;
+		std::string classifier;	// empty for stages that are not specific to a classifier
+		unsigned thread;	// 0 for the main loop, and from 1 for the threads that build classifiers (-j)
+		double start;	// microseconds since the Stats were created
+		double wall;	// microseconds
+		double cpu;	// microseconds
+		long peak_rss;	// kilobytes, of the whole process so far
+		unsigned long allocations;
+	};
+
+	Stats();
+
+	void begin(const char *name, const std::string &classifier = std::string());
+	void end();
+	void merge(const Stats &other);	// adds the stages of other, which must have ended
+
+	double wall(const std::string &classifier) const;	// microseconds spent on the stages of classifier
+	void report(std::ostream &out) const;	// a table of all stages, and totals per classifier
+	bool write_trace(std::string filename) const;	// Chrome trace-event JSON (chrome://tracing)
+
+	std::vector<Stage> stages;
+	bool enabled;
+	unsigned thread;	// of the stages begun from now on
+
+	static __thread unsigned long allocations;	// made by the calling thread so far
+
+private:
+	double origin, cpu_start;
+	unsigned long allocations_start;
+	bool running;
+};
+
+
+//----- Report ----------------------------------------------------------------
+
+// Metrics of every classifier, written as JSON by --report, so that they can be
+// diffed across unicode data and generator versions:
+//
+//		{ "generator": "1.0", "unicode_data": "./UnicodeData.txt", "options": "...",
+//		  "classifiers": [ { "spec": "Lu", "name": "uniclasser_Lu", "codevalues": 1427, ... } ] }
+//
+struct Report
+{
+	struct Classifier
+	{
+		std::string spec, name;
+		unsigned codevalues, ranges;
+		unsigned tree_nodes, predicate_nodes, compare_jumps;
+		unsigned max_compares;
+		double mean_compares;		// per codevalue, weighted as in -W
+		unsigned estimated_size;	// bytes
+		unsigned code_size;			// bytes of x86-64 code
+		double milliseconds;		// generation time
+	};
+	
+	bool write(std::string filename) const;
+	
+	std::string data_filename, options;
+	std::vector<Classifier> classifiers;
+};
+
+
+//----- JSON ------------------------------------------------------------------
+
+// writes s as a quoted JSON string
+void write_json_string(std::ostream &out, const std::string &s);
+
+#endif
@@ -0,0 +1,45 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#include "table_blob.hpp"
+
+using namespace std;
+
+
+//----- TableBlob -------------------------------------------------------------
+
+unsigned TableBlob::add(const string &name, const string &type, const string &bytes, bool swappable)
+{
+	layout.add(name).add(type);
+	if (!swappable) layout.add(bytes);
+	tables.push_back(bytes);
+	return tables.size() - 1;
+}
+
+string TableBlob::content() const
+{
+	// the offsets are laid out first, so that the header can hold the file size
+	vector<uint32_t> words(header_words + 2 * tables.size(), 0);
+	uint32_t size = words.size() * sizeof(uint32_t);
+	for (size_t i = 0, n = tables.size(); i < n; ++i)
+	{
+		size = (size + alignment - 1) / alignment * alignment;
+		words[header_words + 2*i] = size;
+		words[header_words + 2*i + 1] = tables[i].size();
+		size += tables[i].size();
+	}
+	words[0] = magic;
+	words[1] = version;
+	words[2] = key();
+	words[3] = tables.size();
+	words[4] = size;
+
+	string content((const char *)&words[0], words.size() * sizeof(uint32_t));
+	for (size_t i = 0, n = tables.size(); i < n; ++i)
+	{
+		content.resize(words[header_words + 2*i], 0);	// the padding
+		content += tables[i];
+	}
+	return content;
+}
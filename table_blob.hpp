@@ -0,0 +1,76 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+#ifndef TABLE_BLOB_H
+#define TABLE_BLOB_H
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <stdint.h>
+#include "cache.hpp"
+#include "class_table.hpp"
+
+
+//----- TableBlob -------------------------------------------------------------
+
+// All the tables of the generated classifiers, in a single binary file that
+// the generated code maps into memory at startup (-m), rather than compiling
+// them in. Every process that maps the file shares its physical pages. The
+// file is a header of header_words 32-bit words, a directory of an offset
+// and a size in bytes for every table, and the tables themselves, each
+// aligned to alignment bytes. Everything is in the byte order of the
+// generator's machine, which the magic word tells apart.
+//
+// The key ties the file to the generated code: it covers the contents of
+// all the tables whose meaning depends on the code, like those of table and
+// hash predicates, but only the names and types of swappable tables, like
+// those of the segmenter. So the segmenter's tables of another unicode
+// version can be rolled out by replacing the file, while a file whose
+// predicate tables differ from the code is refused.
+struct TableBlob
+{
+	TableBlob(std::string filename) : filename(filename) {}
+
+	unsigned add(const std::string &name, const std::string &type, const std::string &bytes, bool swappable);	// returns the index of the table
+	std::string content() const;
+	uint32_t key() const { return (uint32_t)(layout.h ^ (layout.h >> 32)); }
+
+	static const uint32_t magic = 0x544c4355, version = 1;	// "UCLT" in little endian
+	static const uint32_t header_words = 6;		// magic, version, key, table count, file size, 0
+	static const uint32_t alignment = 64;		// a cache line
+
+	std::string filename;
+	std::vector<std::string> tables;
+	Hash layout;
+};
+
+// writes values as a static C array, or, given a blob, adds them to it and
+// writes a macro by the same name that points into the mapped blob
+template <class T>
+void write_table(std::ostream &out, TableBlob *blob, std::string type, std::string name, const std::vector<T> &values, bool swappable = false)
+{
+	if (blob == 0)
+	{
+		write_array(out, type, name, values);
+		return;
+	}
+
+	// values take the size of the C type they are declared with
+	std::string bytes;
+	for (size_t i = 0, n = values.size(); i < n; ++i)
+	{
+		uint8_t b = (uint8_t)values[i];
+		uint16_t s = (uint16_t)values[i];
+		uint32_t w = (uint32_t)values[i];
+		if (type == "unsigned char") bytes.append((const char *)&b, sizeof(b));
+		else if (type == "unsigned short") bytes.append((const char *)&s, sizeof(s));
+		else bytes.append((const char *)&w, sizeof(w));
+	}
+	unsigned index = blob->add(name, type, bytes, swappable);
+	out << std::dec << "#define " << name << " ((const " << type << " *)(uniclasser_tables + ((const unsigned *)uniclasser_tables)["
+		<< TableBlob::header_words + 2 * index << "]))" << std::endl << std::endl;
+}
+
+#endif
@@ -0,0 +1,53 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+// Tests that category specs are given distinct classifier names, and that
+// specs whose names collide are refused rather than overwriting each other.
+//
+// It is built from all the generator sources except main.cpp:
+//
+//		g++ -o test_identifiers test/test_identifiers.cpp $(ls *.cpp | grep -v '^main.cpp$')
+//
+// and exits with 0 if all the tests pass.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include "../set_expression.hpp"
+
+using namespace std;
+
+unsigned failed = 0;
+
+void check(bool passed, const string &what)
+{
+	if (passed) return;
+	cout << "Failed test: " << what << endl;
+	++failed;
+}
+
+vector<string> specs(const char *a, const char *b)
+{
+	vector<string> s;
+	s.push_back(a);
+	s.push_back(b);
+	return s;
+}
+
+int main()
+{
+	vector<string> names;
+
+	check(SetExpression::identifiers(specs("Lu", "Ll"), names) && names.size() == 2 && names[0] == "Lu" && names[1] == "Ll", "Lu and Ll are distinct");
+	check(SetExpression::identifiers(specs("L&!Lo", "L-Lo"), names) && names[0] == "L_and_not_Lo" && names[1] == "L_minus_Lo", "L&!Lo and L-Lo are distinct");
+
+	cout << "The following errors are expected:" << endl;
+	check(!SetExpression::identifiers(specs("[Zs Zl]", "Zs,Zl"), names), "[Zs Zl] and Zs,Zl collide");
+	check(!SetExpression::identifiers(specs("(Lu)", "Lu"), names), "(Lu) and Lu collide");
+	check(!SetExpression::identifiers(specs("Nd", "Nd"), names), "Nd and Nd collide");
+
+	if (failed == 0) cout << "All tests passed!" << endl;
+	else cout << "Failed " << failed << " tests!" << endl;
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2010 Roy Sharon <roy@roysharon.com>
+// See project repositry at <https://github.com/roysharon/Uniclasser>
+// Using this file is subject to the MIT License <http://creativecommons.org/licenses/MIT/>
+
+// Tests the tables of SimdKernel on categories with many mixed blocks, like
+// Lu and Lo: every code unit outside the surrogates must be classified by
+// the vector path, and looking it up in the tables the way the generated
+// kernel does must agree with the category.
+//
+// It is built from all the generator sources except main.cpp:
+//
+//		g++ -o test_simd_kernel test/test_simd_kernel.cpp $(ls *.cpp | grep -v '^main.cpp$')
+//
+// and run where UnicodeData.txt is (or given its path), exiting with 0 if
+// all the tests pass.
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../unicode_data.hpp"
+#include "../simd_kernel.hpp"
+
+using namespace std;
+
+unsigned failed = 0;
+
+void check(bool passed, const string &what)
+{
+	if (passed) return;
+	cout << "Failed test: " << what << endl;
+	++failed;
+}
+
+bool lookup(const SimdKernel &kernel, unsigned c)	// as the generated kernel does on the vector path
+{
+	unsigned id = kernel.blocks[c >> 8], x = c & 0xFF;
+	if (id < SimdKernel::first_mixed) return id == SimdKernel::full_block;
+	const unsigned char *t = &kernel.tables[(id - SimdKernel::first_mixed) * SimdKernel::table_size];
+	return (t[(x >> 7) * 16 + (x & 15)] >> ((x >> 4) & 7)) & 1;
+}
+
+void test_category(UnicodeData &unicode, const char *gc, unsigned min_mixed)
+{
+	auto_ptr<range_list> ranges(unicode.filter_gc(gc));
+	range_list bmp(1, coderange(0, 0xFFFF));
+	auto_ptr<range_list> bmp_ranges(range_intersection(*ranges, bmp));
+	SimdKernel kernel(*bmp_ranges);
+	cout << gc << ": " << kernel.mixed << " mixed blocks, " << kernel.others << " blocks left to scalar code." << endl;
+
+	check(kernel.mixed >= min_mixed, string(gc) + " has many mixed blocks");
+	check(kernel.others == 8, string(gc) + " leaves only the surrogates to scalar code");
+
+	vector<bool> matched(0x10000, false);
+	for (range_list::const_iterator i = bmp_ranges->begin(); i != bmp_ranges->end(); ++i)
+		for (unsigned c = i->first; c <= (unsigned)i->second; ++c) matched[c] = true;
+
+	unsigned vector_path = 0, wrong = 0;
+	for (unsigned c = 0; c < 0x10000; ++c)
+	{
+		if (kernel.blocks[c >> 8] == SimdKernel::other_block)
+		{
+			check(c >= 0xD800 && c <= 0xDFFF, string(gc) + " sends only surrogates to scalar code");
+			continue;
+		}
+		++vector_path;
+		if (lookup(kernel, c) != matched[c]) ++wrong;
+	}
+	check(vector_path == 0x10000 - 0x800, string(gc) + " classifies all the other code units on the vector path");
+	check(wrong == 0, string(gc) + " tables agree with the category");
+}
+
+int main(int argc, char *argv[])
+{
+	UnicodeData unicode(argc > 1 ? argv[1] : "UnicodeData.txt");
+	if (unicode.count() == 0) return 1;
+
+	test_category(unicode, "Lu", 5);
+	test_category(unicode, "Ll", 5);
+	test_category(unicode, "Lo", 5);
+	test_category(unicode, "Nd", 5);
+	test_category(unicode, "Zs", 1);
+
+	if (failed == 0) cout << "All tests passed!" << endl;
+	else cout << "Failed " << failed << " tests!" << endl;
+	return failed == 0 ? 0 : 1;
+}
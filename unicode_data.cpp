@@ -4,6 +4,7 @@
 
 #include <fstream>
 #include <sstream>
+#include <memory>
 #include "unicode_data.hpp"
 
 using namespace std;
@@ -44,7 +45,7 @@ line_t& UnicodeDataParser::parse_buf()
 	if (cur.empty())
 	{
 		ustring s;
-		for (ustring::const_iterator i = buf.begin(), e = buf.end(); i != e; ++i)
+		for (ustring::const_iterator i = buf.begin(), e = buf.end(); i != e && *i != '#'; ++i)	// the rest of the line after a '#' is a comment
 		{
 			switch (*i) {
 				case ' ':	// ignore whitespace: space
@@ -55,8 +56,6 @@ line_t& UnicodeDataParser::parse_buf()
 					cur.push_back(s);
 					s.clear();
 					continue;
-				case '#':	// rest of line is a comment, so ignore it
-					break;
 				default:
 					s += *i;
 					break;
@@ -69,6 +68,55 @@ line_t& UnicodeDataParser::parse_buf()
 }
 
 
+//----- PropertyFile ----------------------------------------------------------
+
+PropertyFile::PropertyFile(string filename) : filename(filename), loaded(false), lines(0)
+{
+	ifstream data(filename.c_str(), ios_base::in);
+	if (!data)
+	{
+		cerr << "Error: Could not open file " << filename << endl
+			 << "You can download the latest version of the UCD files from http://www.unicode.org/Public/UNIDATA/" << endl;
+		return;
+	}
+	data.unsetf(ios::skipws);
+	
+	// the ranges of every value are collected as listed, and normalized once at the end
+	UnicodeDataParser parser(data);
+	while (!parser.eof())
+	{
+		line_t l = *parser;
+		++parser;
+		if (l.size() < 2 || l[0].empty()) continue;	// a comment or an empty line
+		
+		codevalue first, last;
+		int n = swscanf(l[0].c_str(), L"%x..%x", &first, &last);
+		if (n < 1 || (n == 2 && last < first) || (n == 2 ? last : first) > max_codevalue)
+		{
+			cerr << "Error: Bad range in line " << parser.line_number << " of " << filename << ". Skipping line." << endl;
+			continue;
+		}
+		if (n == 1) last = first;
+		
+		wstring wvalue(l[1].begin(), l[1].end());
+		if (l.size() > 2 && !l[2].empty()) wvalue += L"_" + wstring(l[2].begin(), l[2].end());
+		char value[256];
+		if (wcstombs(value, wvalue.c_str(), sizeof(value)) == (size_t)-1) continue;
+		value[sizeof(value)-1] = 0;
+		
+		values[value].push_back(coderange(first, last));
+		++lines;
+	}
+	
+	for (map<string, range_list>::iterator i = values.begin(); i != values.end(); ++i)
+	{
+		auto_ptr<range_list> normalized(normalize(i->second));
+		i->second.swap(*normalized);
+	}
+	loaded = true;
+}
+
+
 //----- UnicodeData -----------------------------------------------------------
 
 UnicodeData::UnicodeData(std::string filename) : gc_count(0)
@@ -90,7 +138,7 @@ UnicodeData::UnicodeData(std::string filename) : gc_count(0)
 		
 		codevalue c;
 		swscanf(l[0].c_str(), L"%x", &c);
-		add_codevalue(c);
+		add_range(c, c);
 		
 		// parse General Category (second field in each line in UnicodeData.txt)
 		wstring gc(l[2]);
@@ -116,44 +164,58 @@ UnicodeData::UnicodeData(std::string filename) : gc_count(0)
 			
 			codevalue d;
 			swscanf(l[0].c_str(), L"%x", &d);
-			while (++c <= d)
-			{
-				add_codevalue(c);
-				set_property(gc_mask, gc_shift, i->second);
-			}
+			if (d > c) runs.back().second = d;
 		}
+		close_range();
 	}
 	
 	data.close();
 }
 
-void UnicodeData::add_codevalue(codevalue c)
+void UnicodeData::add_range(codevalue first, codevalue last)
 {
-	codevalues.push_back(c);
+	runs.push_back(coderange(first, last));
 	properties.push_back(0);
 }
 
-void UnicodeData::set_property(property_t mask, property_t shift, property_t val) // always set the property of the last codevalue added by add_codevalue()
+void UnicodeData::close_range()
+{
+	// a range that continues the previous one with the same properties joins its run
+	size_t n = runs.size();
+	if (n < 2 || properties[n-1] != properties[n-2] || runs[n-2].second + 1 != runs[n-1].first) return;
+	runs[n-2].second = runs[n-1].second;
+	runs.pop_back();
+	properties.pop_back();
+}
+
+void UnicodeData::set_property(property_t mask, property_t shift, property_t val) // always set the property of the last range added by add_range()
 {
 	properties.back() &= ~mask;
 	properties.back() |= (val << shift) & mask;
 }
 
-codevalue_vector* UnicodeData::filter(property_t mask, property_t val)
+range_list* UnicodeData::filter(property_t mask, property_t val)
 {
-	auto_ptr<codevalue_vector> codes(new codevalue_vector);
-	
-	for (unsigned i = 0, n = count(); i < n; ++i)
+	range_list matched;
+	for (unsigned i = 0, n = runs.size(); i < n; ++i)
 	{
-		if ((properties[i] & mask) == val) codes->push_back(codevalues[i]);
+		if ((properties[i] & mask) == val) matched.push_back(runs[i]);
 	}
-	sort(codes->begin(), codes->end());
-	codes->resize(unique_copy(codes->begin(), codes->end(), codes->begin()) - codes->begin());
+	return normalize(matched);	// merges adjacent runs, and sorts any out of order lines
+}
 
-	return codes.release();
+void UnicodeData::partition(property_t mask, property_t shift, vector<range_list> &lists)
+{
+	lists.assign((mask >> shift) + 1, range_list());
+	for (unsigned i = 0, n = runs.size(); i < n; ++i) lists[(properties[i] & mask) >> shift].push_back(runs[i]);
+	for (vector<range_list>::iterator i = lists.begin(); i != lists.end(); ++i)
+	{
+		auto_ptr<range_list> normalized(normalize(*i));
+		i->swap(*normalized);
+	}
 }
 
-codevalue_vector* UnicodeData::filter_gc(const char * const gc)
+range_list* UnicodeData::filter_gc(const char * const gc)
 {
 	wstringstream wgc;
 	wgc << gc;
@@ -161,28 +223,37 @@ codevalue_vector* UnicodeData::filter_gc(const char * const gc)
 	if (i == gc_map.end() || i->second == 0)
 	{
 		cerr << "Error: General Category '" << gc << "' is undefined. Ignoring." << endl;
-		return new codevalue_vector;
+		return new range_list;
 	}
 	else return filter(gc_mask, propval(gc_mask, gc_shift, i->second));
 }
 
-codevalue_vector* UnicodeData::filter_multiple_gc(const char * const mgc)
+range_list* UnicodeData::filter_multiple_gc(const char * const mgc)
 {
 	string m(mgc);
-	auto_ptr<codevalue_vector> codes(new codevalue_vector);
+	auto_ptr<range_list> codes(new range_list);
 	size_t p = 0, n;
 	do
 	{
 		n = m.find(',', p);
 		string gc = m.substr(p, n == m.npos ? m.npos : n-p);
 		p = n+1;
-		auto_ptr<codevalue_vector> more(filter_gc(gc.c_str()));
-		auto_ptr<codevalue_vector> merged(new codevalue_vector);
-		merged->reserve(codes->size() + more->size());
-		merge(codes->begin(), codes->end(), more->begin(), more->end(), back_inserter(*merged));
-		codes.reset(merged.release());
+		auto_ptr<range_list> more(filter_gc(gc.c_str()));
+		codes.reset(range_union(*codes, *more));
 	} 
 	while (n != m.npos);
 	return codes.release();
 }
 
+void UnicodeData::add_properties(PropertyFile &file)
+{
+	for (map<string, range_list>::iterator i = file.values.begin(); i != file.values.end(); ++i)
+	{
+		if (property_values.find(i->first) != property_values.end())
+		{
+			cerr << "Error: Property value '" << i->first << "' of " << file.filename << " is already defined. Ignoring." << endl;
+			continue;
+		}
+		property_values[i->first].swap(i->second);
+	}
+}
@@ -12,6 +12,7 @@
 #include <string>
 #include <map>
 #include "codevalue.hpp"
+#include "range_list.hpp"
 
 typedef std::vector<ustring> line_t;
 
@@ -55,32 +56,63 @@ struct UnicodeDataParser : std::iterator<std::input_iterator_tag, line_t>
 };
 
 
+//----- PropertyFile ----------------------------------------------------------
+
+// A UCD file that lists ranges of codevalues with a property value each, like
+// Scripts.txt, PropList.txt or DerivedCoreProperties.txt:
+//
+//		0041..005A    ; Latin # L&  [26] LATIN CAPITAL LETTER A..LATIN CAPITAL LETTER Z
+//		0020          ; White_Space # Zs       SPACE
+//
+// The ranges are kept as they are listed, and never expanded to codevalues.
+// A third field, as in DerivedNormalizationProps.txt, is joined to the value
+// with an underscore (NFD_QC_N).
+struct PropertyFile
+{
+	PropertyFile(std::string filename);
+	
+	std::string filename;
+	bool loaded;
+	unsigned lines;		// lines with a range
+	std::map<std::string, range_list> values;	// normalized
+};
+
+
 //----- UnicodeData -----------------------------------------------------------
 
 struct UnicodeData
 {
 	UnicodeData(std::string filename);
 	
-	unsigned count() { return codevalues.size(); }
+	unsigned count() { return range_count(runs); }
 	
 	typedef unsigned char property_t;
 
 	inline property_t propval(property_t mask, property_t shift, property_t val) { return (val << shift) & mask; }
 
-	codevalue_vector* filter(property_t mask, property_t val);
+	range_list* filter(property_t mask, property_t val);
+	void partition(property_t mask, property_t shift, std::vector<range_list> &lists);	// lists[v] = filter(mask, v << shift), in a single pass
 	
-	void add_codevalue(codevalue c);
+	void add_range(codevalue first, codevalue last);
+	void close_range();
 	void set_property(property_t mask, property_t shift, property_t val);
 	
+	// codevalues are kept as runs of consecutive codevalues with the same
+	// properties, so the CJK, Hangul and private use blocks take one entry each
 	std::vector<property_t> properties;
-	codevalue_vector codevalues;
+	range_list runs;
 
 	// General Category property
 	std::map<std::wstring, property_t> gc_map;
 	property_t gc_count;
 	static const property_t gc_mask = 0x1F, gc_shift = 0;
-	codevalue_vector* filter_gc(const char * const gc);
-	codevalue_vector* filter_multiple_gc(const char * const mgc);
+	range_list* filter_gc(const char * const gc);
+	range_list* filter_multiple_gc(const char * const mgc);
+	void partition_gc(std::vector<range_list> &lists) { partition(gc_mask, gc_shift, lists); }	// indexed by the values of gc_map
+	
+	// Properties of PropertyFile files, by value name (Latin, White_Space)
+	std::map<std::string, range_list> property_values;
+	void add_properties(PropertyFile &file);	// takes the values of file
 };
 
 